@@ -0,0 +1,226 @@
+#pragma once
+// Adaptive drills: per-bigram weakness statistics gathered while typing, and an
+// index from each bigram to the passages that contain it most densely.
+#include "Utf8.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+inline uint64_t bigramKey(uint32_t previous, uint32_t current)
+{
+    return ((uint64_t)previous << 32) | current;
+}
+
+// What the user finds hard: mistakes and time taken for each pair of expected characters
+class WeaknessModel
+{
+private:
+    static constexpr int MIN_SAMPLES = 30;        // keys seen before drills are chosen by weakness
+    static constexpr int MIN_ATTEMPTS = 3;        // per bigram, before it can be ranked
+    static constexpr float ERROR_PENALTY_MS = 600; // a mistake costs about this much time
+
+    struct Entry
+    {
+        uint32_t attempts;
+        uint32_t errors;
+        uint32_t timedCount;
+        double totalLatency; // seconds, over timedCount clean transitions
+    };
+
+    std::unordered_map<uint64_t, Entry> entries;
+    int samples;
+    std::vector<std::pair<uint64_t, float>> ranked;
+
+    // Expected milliseconds to get this bigram right, counting retries after mistakes
+    static float cost(const Entry &entry)
+    {
+        float meanLatency = entry.timedCount ? (float)(entry.totalLatency * 1000.0 / entry.timedCount) : 0;
+        float errorRate = (float)entry.errors / entry.attempts;
+        return meanLatency + errorRate * ERROR_PENALTY_MS;
+    }
+
+public:
+    WeaknessModel() : samples(0) {}
+
+    // latency is only meaningful (timed) when the previous key was also correct
+    void addKey(uint32_t previous, uint32_t expected, bool correct, double latency, bool timed)
+    {
+        Entry &entry = entries[bigramKey(previous, expected)];
+        entry.attempts++;
+        if (!correct)
+        {
+            entry.errors++;
+        }
+        else if (timed)
+        {
+            entry.timedCount++;
+            entry.totalLatency += latency;
+        }
+        samples++;
+    }
+
+    bool hasData() const { return samples >= MIN_SAMPLES; }
+
+    // Fills out with up to count of the weakest bigrams, weakest first, each
+    // weighted by how much slower than average it is
+    void getWeakest(int count, std::vector<std::pair<uint64_t, float>> &out)
+    {
+        ranked.clear();
+        float totalCost = 0;
+        for (const auto &item : entries)
+        {
+            if (item.second.attempts < MIN_ATTEMPTS)
+                continue;
+            float itemCost = cost(item.second);
+            ranked.push_back(std::make_pair(item.first, itemCost));
+            totalCost += itemCost;
+        }
+
+        out.clear();
+        if (ranked.empty() || totalCost <= 0)
+            return;
+        int keep = std::min(count, (int)ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                          [](const std::pair<uint64_t, float> &a, const std::pair<uint64_t, float> &b) { return a.second > b.second; });
+        float averageCost = totalCost / ranked.size();
+        for (int i = 0; i < keep; i++)
+            out.push_back(std::make_pair(ranked[i].first, ranked[i].second / averageCost));
+    }
+};
+
+// For every bigram, the passages where it is densest. Built once per passage pool
+// on a background thread so large corpora do not delay startup.
+class DrillIndex
+{
+private:
+    static constexpr int POSTINGS_PER_BIGRAM = 64;
+    static constexpr int WEAK_BIGRAMS = 8; // usually asked for at once; more only grows the scratch space once
+
+    struct Posting
+    {
+        int passage;
+        float density; // occurrences per character
+    };
+
+    std::unordered_map<uint64_t, std::vector<Posting>> postings;
+    std::atomic<bool> ready;
+    std::thread builder;
+    // Scratch space for findPassages(), kept between calls so picking a drill does
+    // not allocate: a score per passage (-1 when untouched) and the touched passages
+    std::vector<float> scores;
+    std::vector<int> touched;
+    std::vector<std::pair<int, float>> ordered;
+
+    static bool denser(const Posting &a, const Posting &b) { return a.density > b.density; }
+
+    void build(int count, std::function<const char *(int, int &)> passage)
+    {
+        std::unordered_map<uint64_t, int> local;
+        std::vector<int> decoded;
+        for (int i = 0; i < count; i++)
+        {
+            int length = 0;
+            const char *text = passage(i, length);
+            if (!text || length < 2)
+                continue;
+
+            local.clear();
+            decodeUtf8(text, length, decoded);
+            for (size_t c = 1; c < decoded.size(); c++)
+                local[bigramKey(decoded[c - 1], decoded[c])]++;
+
+            for (const auto &item : local)
+            {
+                // Keep the densest passages in a min-heap capped at POSTINGS_PER_BIGRAM
+                std::vector<Posting> &list = postings[item.first];
+                Posting posting = {i, (float)item.second / decoded.size()};
+                if ((int)list.size() < POSTINGS_PER_BIGRAM)
+                {
+                    list.push_back(posting);
+                    std::push_heap(list.begin(), list.end(), denser);
+                }
+                else if (posting.density > list.front().density)
+                {
+                    std::pop_heap(list.begin(), list.end(), denser);
+                    list.back() = posting;
+                    std::push_heap(list.begin(), list.end(), denser);
+                }
+            }
+        }
+        scores.assign(count, -1.0f);
+        touched.reserve(WEAK_BIGRAMS * POSTINGS_PER_BIGRAM);
+        ordered.reserve(WEAK_BIGRAMS * POSTINGS_PER_BIGRAM);
+        ready = true;
+    }
+
+public:
+    DrillIndex() : ready(false) {}
+
+    ~DrillIndex()
+    {
+        if (builder.joinable())
+            builder.join();
+    }
+
+    DrillIndex(const DrillIndex &) = delete;
+    DrillIndex &operator=(const DrillIndex &) = delete;
+
+    // passage(i, length) must return passage i and its length, and stay valid while building
+    void buildAsync(int count, std::function<const char *(int, int &)> passage)
+    {
+        if (builder.joinable())
+            builder.join();
+        ready = false;
+        postings.clear();
+        builder = std::thread(&DrillIndex::build, this, count, passage);
+    }
+
+    bool isReady() const { return ready; }
+
+    // Fills out with up to maxCount passages that best cover the weak bigrams,
+    // best first; costs O(weak bigrams x POSTINGS_PER_BIGRAM)
+    void findPassages(const std::vector<std::pair<uint64_t, float>> &weak, int exclude, int maxCount,
+                      std::vector<int> &out)
+    {
+        out.clear();
+        if (!ready)
+            return;
+
+        touched.clear();
+        for (const auto &bigram : weak)
+        {
+            auto found = postings.find(bigram.first);
+            if (found == postings.end())
+                continue;
+            for (const Posting &posting : found->second)
+            {
+                if (posting.passage == exclude)
+                    continue;
+                float &score = scores[posting.passage];
+                if (score < 0)
+                {
+                    score = 0;
+                    touched.push_back(posting.passage);
+                }
+                score += bigram.second * posting.density;
+            }
+        }
+
+        ordered.clear();
+        for (int passage : touched)
+        {
+            ordered.push_back(std::make_pair(passage, scores[passage]));
+            scores[passage] = -1.0f;
+        }
+        int keep = std::min(maxCount, (int)ordered.size());
+        std::partial_sort(ordered.begin(), ordered.begin() + keep, ordered.end(),
+                          [](const std::pair<int, float> &a, const std::pair<int, float> &b) { return a.second > b.second; });
+        for (int i = 0; i < keep; i++)
+            out.push_back(ordered[i].first);
+    }
+};
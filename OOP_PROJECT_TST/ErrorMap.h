@@ -0,0 +1,107 @@
+#pragma once
+// Per-character mistake tracking: one bit per text position
+#include <cstdint>
+#include <vector>
+
+// A stretch of text drawn in one colour, either all mistyped or all clean
+struct ErrorRun
+{
+    int start;
+    int end; // one past the last character
+    bool error;
+};
+
+class ErrorBitmap
+{
+private:
+    std::vector<uint64_t> bits;
+    int length;
+
+    static int countTrailingZeros(uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(value);
+#else
+        int count = 0;
+        while (!(value & 1))
+        {
+            value >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    // Position of the first bit in [from, to) equal to value, or to if there is none
+    int find(int from, int to, bool value) const
+    {
+        to = to < length ? to : length;
+        while (from < to)
+        {
+            uint64_t word = bits[from >> 6];
+            if (!value)
+                word = ~word;
+            word &= ~0ULL << (from & 63);
+            if (word)
+            {
+                int found = (from & ~63) + countTrailingZeros(word);
+                return found < to ? found : to;
+            }
+            from = (from & ~63) + 64;
+        }
+        return to;
+    }
+
+public:
+    ErrorBitmap() : length(0) {}
+
+    // Sizes the bitmap for a text and clears it; keeps its capacity
+    void reset(int textLength)
+    {
+        length = textLength;
+        bits.assign((textLength + 63) / 64, 0);
+    }
+
+    void set(int position)
+    {
+        if (position >= 0 && position < length)
+            bits[position >> 6] |= 1ULL << (position & 63);
+    }
+
+    bool test(int position) const
+    {
+        return position >= 0 && position < length && (bits[position >> 6] >> (position & 63)) & 1;
+    }
+
+    int getLength() const { return length; }
+
+    // Number of mistyped positions in [from, to)
+    int count(int from, int to) const
+    {
+        int total = 0;
+        to = to < length ? to : length;
+        for (int i = find(from, to, true); i < to; i = find(i, to, true))
+        {
+            int end = find(i, to, false);
+            total += end - i;
+            i = end;
+        }
+        return total;
+    }
+
+    // Splits [from, to) into alternating clean and mistyped runs. The work is
+    // proportional to the number of runs, not the number of characters.
+    void runs(int from, int to, std::vector<ErrorRun> &out) const
+    {
+        out.clear();
+        to = to < length ? to : length;
+        bool error = test(from);
+        while (from < to)
+        {
+            int end = find(from, to, !error);
+            out.push_back(ErrorRun{from, end, error});
+            from = end;
+            error = !error;
+        }
+    }
+};
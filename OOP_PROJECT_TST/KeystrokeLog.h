@@ -0,0 +1,265 @@
+#pragma once
+// Binary per-keystroke log: sessions are appended to a file as blocks of
+// fixed-size records and read back zero-copy from a memory mapping.
+#include "MappedFile.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+const uint32_t KEYLOG_MAGIC = 0x4c4b5354; // "TSKL"
+const uint8_t KEYLOG_SESSION_START = 1;   // first block of a session, later blocks continue it
+const int KEYLOG_OUTCOME_SHIFT = 1;       // flags bits 1-2 of a session's last block: a KeystrokeOutcome
+
+// How a session ended. Blocks written mid-session, and logs from older builds, say unknown.
+enum KeystrokeOutcome
+{
+    KEYLOG_OUTCOME_UNKNOWN = 0,
+    KEYLOG_COMPLETED,
+    KEYLOG_TIMED_OUT,
+    KEYLOG_ABANDONED // restarted, switched away or closed before the end
+};
+
+struct KeystrokeBlockHeader
+{
+    uint32_t magic;
+    uint8_t mode;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t paragraph;
+    uint32_t count; // number of records following this header
+};
+
+struct KeystrokeRecord
+{
+    uint32_t codepoint; // key that was pressed
+    uint32_t expected;  // character the text expected at that point
+    uint32_t delta;     // microseconds since the previous key (or session start), top bit = correct
+
+    uint32_t getDeltaMicros() const { return delta & 0x7fffffffu; }
+    bool isCorrect() const { return (delta & 0x80000000u) != 0; }
+};
+
+static_assert(sizeof(KeystrokeBlockHeader) == 16, "keystroke log header must stay 16 bytes");
+static_assert(sizeof(KeystrokeRecord) == 12, "keystroke records must stay 12 bytes");
+
+// Records keys into one of two buffers allocated once up front. When a session
+// ends, or the buffer fills up mid-session, the buffer is swapped with the spare
+// and a writer thread appends it to the file as a block, so record() never does
+// file I/O. It only waits if the writer is still busy with the previous block.
+class KeystrokeLog
+{
+private:
+    std::vector<KeystrokeRecord> records; // being filled
+    std::vector<KeystrokeRecord> spare;   // being written while pending, otherwise free
+    int count;
+    const char *path;
+    FILE *file; // only used by the writer thread
+    bool active;
+    bool blockStartsSession;
+    uint8_t mode;
+    uint32_t paragraph;
+    double lastTime;
+
+    std::thread writer; // started on the first block
+    std::mutex lock;
+    std::condition_variable wake; // a block is pending, or the log is closing
+    std::condition_variable idle; // the pending block was written
+    bool pending;
+    bool stopping;
+    KeystrokeBlockHeader pendingHeader;
+
+    // Hands the filled buffer to the writer thread. The last block of a session is
+    // written even when empty, since it carries the outcome.
+    void submit(KeystrokeOutcome outcome)
+    {
+        if (count == 0 && !blockStartsSession && outcome == KEYLOG_OUTCOME_UNKNOWN)
+            return;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            idle.wait(guard, [this] { return !pending; });
+            pendingHeader = KeystrokeBlockHeader{KEYLOG_MAGIC, mode, 0, 0, paragraph, (uint32_t)count};
+            pendingHeader.flags = (uint8_t)((blockStartsSession ? KEYLOG_SESSION_START : 0) | outcome << KEYLOG_OUTCOME_SHIFT);
+            records.swap(spare);
+            pending = true;
+            if (!writer.joinable())
+                writer = std::thread(&KeystrokeLog::writeBlocks, this);
+        }
+        wake.notify_one();
+        count = 0;
+        blockStartsSession = false;
+    }
+
+    void writeBlocks()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;)
+        {
+            wake.wait(guard, [this] { return pending || stopping; });
+            if (!pending)
+                return;
+            KeystrokeBlockHeader header = pendingHeader;
+            guard.unlock();
+
+            if (!file)
+                file = fopen(path, "ab");
+            if (file)
+            {
+                fwrite(&header, sizeof(header), 1, file);
+                fwrite(spare.data(), sizeof(KeystrokeRecord), header.count, file);
+                fflush(file);
+            }
+
+            guard.lock();
+            pending = false;
+            idle.notify_all();
+        }
+    }
+
+public:
+    KeystrokeLog(const char *logPath, int capacity = 4096)
+        : records(capacity), spare(capacity), count(0), path(logPath), file(nullptr), active(false),
+          blockStartsSession(false), mode(0), paragraph(0), lastTime(0), pending(false), stopping(false),
+          pendingHeader()
+    {
+    }
+
+    // Waits until every submitted block is on disk
+    ~KeystrokeLog()
+    {
+        endSession();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (writer.joinable())
+            writer.join();
+        if (file)
+            fclose(file);
+    }
+
+    KeystrokeLog(const KeystrokeLog &) = delete;
+    KeystrokeLog &operator=(const KeystrokeLog &) = delete;
+
+    bool isActive() const { return active; }
+
+    void beginSession(int modeId, int paragraphIndex, double startTime)
+    {
+        endSession();
+        active = true;
+        blockStartsSession = true;
+        mode = (uint8_t)modeId;
+        paragraph = (uint32_t)paragraphIndex;
+        lastTime = startTime;
+        count = 0;
+    }
+
+    void record(int codepoint, int expected, bool correct, double keyTime)
+    {
+        if (!active)
+            return;
+        if (count == (int)records.size())
+            submit(KEYLOG_OUTCOME_UNKNOWN);
+
+        double micros = (keyTime - lastTime) * 1000000.0;
+        uint32_t delta = micros <= 0 ? 0 : (micros >= 0x7fffffff ? 0x7fffffffu : (uint32_t)micros);
+        // Keep the stored deltas summing to the real elapsed time despite rounding
+        lastTime += delta / 1000000.0;
+
+        KeystrokeRecord &entry = records[count++];
+        entry.codepoint = (uint32_t)codepoint;
+        entry.expected = (uint32_t)expected;
+        entry.delta = delta | (correct ? 0x80000000u : 0);
+    }
+
+    void endSession(KeystrokeOutcome outcome = KEYLOG_ABANDONED)
+    {
+        if (!active)
+            return;
+        submit(outcome);
+        active = false;
+    }
+};
+
+// One session read back from a mapped log; records point straight into the mapping
+struct KeystrokeSession
+{
+    int mode;
+    int paragraph;
+    KeystrokeOutcome outcome;
+    // Blocks of the session in file order, each a (records, count) span
+    std::vector<std::pair<const KeystrokeRecord *, uint32_t>> blocks;
+};
+
+// Walks the sessions of a keystroke log file without copying any records
+class KeystrokeLogReader
+{
+private:
+    MappedFile mapping;
+    size_t offset;
+    size_t end;
+
+    const KeystrokeBlockHeader *peekHeader() const
+    {
+        if (offset + sizeof(KeystrokeBlockHeader) > end)
+            return nullptr;
+        const KeystrokeBlockHeader *header = (const KeystrokeBlockHeader *)(mapping.getData() + offset);
+        if (header->magic != KEYLOG_MAGIC)
+            return nullptr;
+        if (offset + sizeof(KeystrokeBlockHeader) + (size_t)header->count * sizeof(KeystrokeRecord) > end)
+            return nullptr; // truncated tail, e.g. from a crash mid-write
+        return header;
+    }
+
+public:
+    KeystrokeLogReader() : offset(0), end(0) {}
+
+    bool open(const char *path)
+    {
+        offset = 0;
+        bool opened = mapping.open(path);
+        end = mapping.getSize();
+        return opened;
+    }
+
+    size_t getSize() const { return mapping.getSize(); }
+    size_t getOffset() const { return offset; }
+
+    // Restricts reading to the byte range [begin, rangeEnd), which must start at a block header
+    void setRange(size_t begin, size_t rangeEnd)
+    {
+        offset = begin;
+        end = rangeEnd < mapping.getSize() ? rangeEnd : mapping.getSize();
+    }
+
+    // Fills in the next session; returns false at the end of the file
+    bool nextSession(KeystrokeSession &session)
+    {
+        const KeystrokeBlockHeader *header = peekHeader();
+        while (header && !(header->flags & KEYLOG_SESSION_START))
+        {
+            // Skip continuation blocks whose session start was lost
+            offset += sizeof(KeystrokeBlockHeader) + (size_t)header->count * sizeof(KeystrokeRecord);
+            header = peekHeader();
+        }
+        if (!header)
+            return false;
+
+        session.mode = header->mode;
+        session.paragraph = (int)header->paragraph;
+        session.blocks.clear();
+        do
+        {
+            const KeystrokeRecord *first = (const KeystrokeRecord *)(header + 1);
+            session.blocks.push_back(std::make_pair(first, header->count));
+            session.outcome = (KeystrokeOutcome)((header->flags >> KEYLOG_OUTCOME_SHIFT) & 3);
+            offset += sizeof(KeystrokeBlockHeader) + (size_t)header->count * sizeof(KeystrokeRecord);
+            header = peekHeader();
+        } while (header && !(header->flags & KEYLOG_SESSION_START));
+        return true;
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+// Memory mapping of a whole file, read-only or (for small fixed-size files) read-write
+#include <cstddef>
+
+#ifdef _WIN32
+// Keep windows.h from clashing with raylib names (Rectangle, CloseWindow, DrawText...)
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#define NOUSER
+#include <windows.h>
+#undef near
+#undef far
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+private:
+    unsigned char *data;
+    size_t size;
+    bool writable;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+public:
+#ifdef _WIN32
+    MappedFile() : data(nullptr), size(0), writable(false), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+    MappedFile() : data(nullptr), size(0), writable(false), fd(-1) {}
+#endif
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *getData() const { return data; }
+    unsigned char *getWritableData() { return writable ? data : nullptr; }
+    size_t getSize() const { return size; }
+    bool isOpen() const { return data != nullptr; }
+
+    // Maps the file; empty or missing files leave the mapping closed
+    bool open(const char *path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            close();
+            return false;
+        }
+        data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data)
+        {
+            close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+#else
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close();
+            return false;
+        }
+        void *view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data = (unsigned char *)view;
+        size = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+    // Maps the file for writing, creating it or resizing it to exactly fileSize bytes;
+    // sets created when the file was new or had a different size
+    bool openWritable(const char *path, size_t fileSize, bool &created)
+    {
+        close();
+        created = false;
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER currentSize;
+        if (!GetFileSizeEx(file, &currentSize))
+        {
+            close();
+            return false;
+        }
+        created = (size_t)currentSize.QuadPart != fileSize;
+        if (created)
+        {
+            LARGE_INTEGER newSize;
+            newSize.QuadPart = (LONGLONG)fileSize;
+            if (!SetFilePointerEx(file, newSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+            {
+                close();
+                return false;
+            }
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (!mapping)
+        {
+            close();
+            return false;
+        }
+        data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+        if (!data)
+        {
+            close();
+            return false;
+        }
+#else
+        fd = ::open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close();
+            return false;
+        }
+        created = (size_t)info.st_size != fileSize;
+        if (created && ftruncate(fd, (off_t)fileSize) != 0)
+        {
+            close();
+            return false;
+        }
+        void *view = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        data = (unsigned char *)view;
+#endif
+        size = fileSize;
+        writable = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap(data, size);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+        writable = false;
+    }
+};
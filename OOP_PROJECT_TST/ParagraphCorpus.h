@@ -0,0 +1,160 @@
+#pragma once
+// External paragraph corpus: a header, an offset/length index sorted by difficulty
+// tier, then the null-terminated passages. The file is memory-mapped, so opening
+// it costs the same whatever its size and passages are only paged in when used.
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+const uint32_t CORPUS_MAGIC = 0x43545354; // "TSTC"
+const uint32_t CORPUS_VERSION = 1;
+const int CORPUS_TIERS = 3; // 0 = Easy, 1 = Medium, 2 = Hard
+
+struct CorpusHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t tierStart[CORPUS_TIERS];
+    uint32_t tierCount[CORPUS_TIERS];
+    uint32_t reserved; // keeps the index that follows 8-byte aligned
+};
+
+struct CorpusEntry
+{
+    uint64_t offset; // from the start of the file
+    uint32_t length; // in bytes, not counting the terminating null
+    uint32_t tier;
+};
+
+static_assert(sizeof(CorpusHeader) == 40, "corpus header must stay 40 bytes");
+static_assert(sizeof(CorpusEntry) == 16, "corpus entries must stay 16 bytes");
+
+class ParagraphCorpus
+{
+private:
+    MappedFile mapping;
+    const CorpusHeader *header;
+    const CorpusEntry *entries;
+
+public:
+    ParagraphCorpus() : header(nullptr), entries(nullptr) {}
+
+    bool open(const char *path)
+    {
+        header = nullptr;
+        entries = nullptr;
+        if (!mapping.open(path))
+            return false;
+
+        const CorpusHeader *candidate = (const CorpusHeader *)mapping.getData();
+        if (mapping.getSize() < sizeof(CorpusHeader) || candidate->magic != CORPUS_MAGIC ||
+            candidate->version != CORPUS_VERSION ||
+            mapping.getSize() < sizeof(CorpusHeader) + (uint64_t)candidate->count * sizeof(CorpusEntry))
+        {
+            mapping.close();
+            return false;
+        }
+        for (int tier = 0; tier < CORPUS_TIERS; tier++)
+        {
+            if ((uint64_t)candidate->tierStart[tier] + candidate->tierCount[tier] > candidate->count)
+            {
+                mapping.close();
+                return false;
+            }
+        }
+
+        header = candidate;
+        entries = (const CorpusEntry *)(mapping.getData() + sizeof(CorpusHeader));
+        return true;
+    }
+
+    bool isOpen() const { return header != nullptr; }
+    int getCount() const { return header ? (int)header->count : 0; }
+    int getTierStart(int tier) const { return header ? (int)header->tierStart[tier] : 0; }
+    int getTierCount(int tier) const { return header ? (int)header->tierCount[tier] : 0; }
+
+    // Passage text straight from the mapping, or nullptr if the entry is damaged
+    const char *getText(int index) const
+    {
+        const CorpusEntry &entry = entries[index];
+        if (entry.offset + entry.length >= mapping.getSize() || mapping.getData()[entry.offset + entry.length] != '\0')
+            return nullptr;
+        return (const char *)(mapping.getData() + entry.offset);
+    }
+
+    int getLength(int index) const { return (int)entries[index].length; }
+
+    // Builds a corpus file from a text file with one passage per line, written as
+    // "easy", "medium" or "hard", a tab, then the passage
+    static bool build(const char *inputPath, const char *outputPath)
+    {
+        static const char *tierNames[CORPUS_TIERS] = {"easy", "medium", "hard"};
+
+        FILE *input = fopen(inputPath, "rb");
+        if (!input)
+            return false;
+
+        std::vector<std::string> tiers[CORPUS_TIERS];
+        std::string line;
+        int c;
+        do
+        {
+            c = fgetc(input);
+            if (c != '\n' && c != EOF)
+            {
+                line.push_back((char)c);
+                continue;
+            }
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            size_t tab = line.find('\t');
+            if (tab != std::string::npos && tab + 1 < line.size())
+            {
+                for (int tier = 0; tier < CORPUS_TIERS; tier++)
+                {
+                    if (line.compare(0, tab, tierNames[tier]) == 0)
+                        tiers[tier].push_back(line.substr(tab + 1));
+                }
+            }
+            line.clear();
+        } while (c != EOF);
+        fclose(input);
+
+        CorpusHeader fileHeader = {CORPUS_MAGIC, CORPUS_VERSION, 0, {0, 0, 0}, {0, 0, 0}, 0};
+        for (int tier = 0; tier < CORPUS_TIERS; tier++)
+        {
+            fileHeader.tierStart[tier] = fileHeader.count;
+            fileHeader.tierCount[tier] = (uint32_t)tiers[tier].size();
+            fileHeader.count += fileHeader.tierCount[tier];
+        }
+
+        std::vector<CorpusEntry> index;
+        index.reserve(fileHeader.count);
+        uint64_t offset = sizeof(CorpusHeader) + (uint64_t)fileHeader.count * sizeof(CorpusEntry);
+        for (int tier = 0; tier < CORPUS_TIERS; tier++)
+        {
+            for (const std::string &passage : tiers[tier])
+            {
+                CorpusEntry entry = {offset, (uint32_t)passage.size(), (uint32_t)tier};
+                index.push_back(entry);
+                offset += passage.size() + 1;
+            }
+        }
+
+        FILE *output = fopen(outputPath, "wb");
+        if (!output)
+            return false;
+        fwrite(&fileHeader, sizeof(fileHeader), 1, output);
+        fwrite(index.data(), sizeof(CorpusEntry), index.size(), output);
+        for (int tier = 0; tier < CORPUS_TIERS; tier++)
+        {
+            for (const std::string &passage : tiers[tier])
+                fwrite(passage.c_str(), 1, passage.size() + 1, output);
+        }
+        return fclose(output) == 0;
+    }
+};
@@ -0,0 +1,207 @@
+#pragma once
+// Lightweight frame profiler. Scoped timers add phase timings to the current
+// frame; finished frames go into a fixed ring that the overlay and the Chrome
+// trace export read. Everything is skipped behind one branch while disabled,
+// and defining TST_NO_PROFILER compiles the scopes out entirely.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+enum ProfilePhase
+{
+    PHASE_INPUT,
+    PHASE_UPDATE,
+    PHASE_DRAW,
+    PHASE_LAYOUT, // nested inside PHASE_DRAW
+    PHASE_PRESENT,
+    PHASE_COUNT
+};
+
+struct FrameTiming
+{
+    double start; // seconds on the profiler clock
+    float frameMs;
+    float inputLatencyMs; // from the poll that delivered a key to the end of presenting it, 0 without input
+    float phaseStartMs[PHASE_COUNT]; // relative to the frame start
+    float phaseMs[PHASE_COUNT];
+};
+
+class FrameProfiler
+{
+private:
+    static constexpr int FRAMES = 256;
+    FrameTiming frames[FRAMES];
+    // Written only by the frame loop; readers see every frame before this index
+    std::atomic<uint32_t> frameCount;
+    FrameTiming current;
+    bool enabled;
+    double lastPollTime;
+    double pendingInputTime; // poll time of the oldest key not yet on screen, 0 if none
+
+public:
+    FrameProfiler() : frameCount(0), current(), enabled(false), lastPollTime(0), pendingInputTime(0) {}
+
+    static double now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static const char *phaseName(int phase)
+    {
+        static const char *names[PHASE_COUNT] = {"handleInput", "update", "draw", "layout", "EndDrawing"};
+        return names[phase];
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    void setEnabled(bool on)
+    {
+        enabled = on;
+        pendingInputTime = 0;
+        current = FrameTiming();
+        current.start = now();
+    }
+
+    void beginFrame()
+    {
+        if (!enabled)
+            return;
+        current = FrameTiming();
+        current.start = now();
+    }
+
+    void addPhase(ProfilePhase phase, double start, double end)
+    {
+        // Phases that run more than once per frame add up, starting at their first run
+        if (current.phaseMs[phase] == 0)
+            current.phaseStartMs[phase] = (float)((start - current.start) * 1000.0);
+        current.phaseMs[phase] += (float)((end - start) * 1000.0);
+    }
+
+    // Called right after input events were polled
+    void markPoll()
+    {
+        if (enabled)
+            lastPollTime = now();
+    }
+
+    // Called when keys from the latest poll were consumed
+    void markInput()
+    {
+        if (enabled && pendingInputTime == 0)
+            pendingInputTime = lastPollTime;
+    }
+
+    // Frames that were not presented (nothing to redraw) are dropped
+    void endFrame(bool presented)
+    {
+        if (!enabled || !presented)
+            return;
+        double end = now();
+        current.frameMs = (float)((end - current.start) * 1000.0);
+        if (pendingInputTime > 0)
+        {
+            current.inputLatencyMs = (float)((end - pendingInputTime) * 1000.0);
+            pendingInputTime = 0;
+        }
+        uint32_t index = frameCount.load(std::memory_order_relaxed);
+        frames[index % FRAMES] = current;
+        frameCount.store(index + 1, std::memory_order_release);
+    }
+
+    int getFrameCount() const
+    {
+        return (int)std::min<uint32_t>(frameCount.load(std::memory_order_acquire), FRAMES);
+    }
+
+    // i = 0 is the newest frame
+    const FrameTiming &getFrame(int i) const
+    {
+        uint32_t count = frameCount.load(std::memory_order_acquire);
+        return frames[(count - 1 - i) % FRAMES];
+    }
+
+    void getFrameStats(float &averageMs, float &p99Ms, float &latencyMs) const
+    {
+        float sorted[FRAMES];
+        int count = getFrameCount();
+        float total = 0;
+        latencyMs = 0;
+        for (int i = 0; i < count; i++)
+        {
+            sorted[i] = getFrame(i).frameMs;
+            total += sorted[i];
+            if (latencyMs == 0 && getFrame(i).inputLatencyMs > 0)
+                latencyMs = getFrame(i).inputLatencyMs;
+        }
+        averageMs = count ? total / count : 0;
+        p99Ms = 0;
+        if (count)
+        {
+            int rank = std::min(count - 1, (int)(count * 0.99f));
+            std::nth_element(sorted, sorted + rank, sorted + count);
+            p99Ms = sorted[rank];
+        }
+    }
+
+    // Writes the frames in the ring as complete events of the Chrome trace format
+    bool exportChromeTrace(const char *path) const
+    {
+        FILE *out = fopen(path, "w");
+        if (!out)
+            return false;
+        fprintf(out, "{\"traceEvents\":[\n");
+        bool first = true;
+        for (int i = getFrameCount() - 1; i >= 0; i--)
+        {
+            const FrameTiming &frame = getFrame(i);
+            double frameUs = frame.start * 1000000.0;
+            fprintf(out, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f,"
+                         "\"args\":{\"inputLatencyMs\":%.3f}}",
+                    first ? "" : ",\n", frameUs, frame.frameMs * 1000.0, frame.inputLatencyMs);
+            first = false;
+            for (int phase = 0; phase < PHASE_COUNT; phase++)
+            {
+                if (frame.phaseMs[phase] == 0)
+                    continue;
+                fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f}",
+                        phaseName(phase), frameUs + frame.phaseStartMs[phase] * 1000.0, frame.phaseMs[phase] * 1000.0);
+            }
+        }
+        fprintf(out, "\n]}\n");
+        return fclose(out) == 0;
+    }
+};
+
+// Times the enclosing scope as one phase of the current frame
+class ProfileScope
+{
+private:
+    FrameProfiler &profiler;
+    ProfilePhase phase;
+    bool timed; // the profiler was on when the scope began; toggling it inside the scope drops the phase
+    double start;
+
+public:
+    ProfileScope(FrameProfiler &frameProfiler, ProfilePhase profilePhase)
+        : profiler(frameProfiler), phase(profilePhase), timed(frameProfiler.isEnabled()),
+          start(timed ? FrameProfiler::now() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (timed && profiler.isEnabled())
+            profiler.addPhase(phase, start, FrameProfiler::now());
+    }
+};
+
+#ifdef TST_NO_PROFILER
+#define PROFILE_SCOPE(profiler, phase)
+#else
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(profiler, phase) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(profiler, phase)
+#endif
@@ -0,0 +1,159 @@
+#pragma once
+// Client side of a race: joins races on the race server, forwards typed keys in
+// one batch per frame and keeps the latest standings. Never blocks. POSIX only.
+#include "RaceProtocol.h"
+#include <algorithm>
+
+class RaceClient
+{
+private:
+    RaceConnection connection;
+    char name[RACE_NAME_LENGTH];
+    char room[RACE_NAME_LENGTH];
+    std::vector<uint32_t> keys;
+    bool joined;
+    bool racing;
+    bool startPending;
+    bool finished;
+    RaceStart start;
+    RaceStandingsHeader standings;
+    RaceStanding rows[RACE_STANDINGS_SHOWN + 1];
+
+    void disconnect()
+    {
+        connection.close();
+        joined = racing = startPending = false;
+    }
+
+    void readStandings(const uint8_t *data, size_t length)
+    {
+        RaceStandingsHeader header;
+        if (length < sizeof(header))
+            return;
+        memcpy(&header, data, sizeof(header));
+        if (header.count > RACE_STANDINGS_SHOWN + 1 || length < sizeof(header) + header.count * sizeof(RaceStanding))
+            return;
+        standings = header;
+        memcpy(rows, data + sizeof(header), header.count * sizeof(RaceStanding));
+    }
+
+public:
+    RaceClient() : joined(false), racing(false), startPending(false), finished(false), start(), standings()
+    {
+        copyRaceName(name, "player");
+        copyRaceName(room, "");
+    }
+
+    bool connect(const char *address, const char *playerName, const char *roomName)
+    {
+        int fd = raceConnect(address);
+        if (fd < 0)
+            return false;
+        connection.open(fd);
+        copyRaceName(name, playerName);
+        copyRaceName(room, roomName);
+        return true;
+    }
+
+    bool isConnected() { return connection.isOpen(); }
+
+    // Asks for a place in the next race of a mode (0-2)
+    void join(int mode)
+    {
+        if (!connection.isOpen())
+            return;
+        RaceJoin message = {};
+        message.mode = (uint8_t)mode;
+        memcpy(message.name, name, RACE_NAME_LENGTH);
+        memcpy(message.room, room, RACE_NAME_LENGTH);
+        if (!connection.send(RACE_JOIN, &message, sizeof(message)) || !connection.flush())
+        {
+            disconnect();
+            return;
+        }
+        joined = true;
+        racing = false;
+        finished = false;
+        standings = RaceStandingsHeader();
+        keys.clear();
+    }
+
+    void addKey(int codepoint)
+    {
+        if (racing)
+            keys.push_back((uint32_t)codepoint);
+    }
+
+    // Sends the keys added since the last call; the server timestamps them on arrival
+    void flush()
+    {
+        size_t sent = 0;
+        while (sent < keys.size() && connection.isOpen())
+        {
+            size_t count = std::min(keys.size() - sent, (size_t)RACE_MAX_KEYS);
+            if (!connection.send(RACE_KEYS, keys.data() + sent, count * 4))
+                disconnect();
+            sent += count;
+        }
+        keys.clear();
+        if (connection.isOpen() && !connection.flush())
+            disconnect();
+    }
+
+    // Reads whatever the server sent; returns true if anything on screen changes
+    bool poll()
+    {
+        if (!connection.isOpen())
+            return false;
+        if (!connection.receive())
+        {
+            disconnect();
+            return true;
+        }
+
+        bool changed = false;
+        RaceHeader header;
+        const uint8_t *data;
+        while (connection.next(header, data))
+        {
+            if (header.type == RACE_START && header.length == sizeof(RaceStart))
+            {
+                memcpy(&start, data, sizeof(start));
+                startPending = true;
+                racing = true;
+            }
+            else if (header.type == RACE_STANDINGS || header.type == RACE_FINISHED)
+            {
+                readStandings(data, header.length);
+                if (header.type == RACE_FINISHED)
+                {
+                    joined = racing = false;
+                    finished = true;
+                }
+            }
+            changed = true;
+        }
+        return changed;
+    }
+
+    // Hands out a race start once, so the caller can begin typing the passage
+    bool takeStart(RaceStart &out)
+    {
+        if (!startPending)
+            return false;
+        out = start;
+        startPending = false;
+        return true;
+    }
+
+    // Joined and waiting for the race to start
+    bool isWaiting() { return joined && !racing; }
+    // In a race that has not finished yet
+    bool isRacing() { return racing; }
+    // Standings are shown while racing and after the race ended
+    bool hasStandings() { return (racing || finished) && standings.count > 0; }
+
+    uint32_t getPlayerId() { return start.playerId; }
+    const RaceStandingsHeader &getStandings() { return standings; }
+    const RaceStanding &getRow(int i) { return rows[i]; }
+};
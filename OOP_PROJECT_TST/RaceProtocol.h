@@ -0,0 +1,364 @@
+#pragma once
+// Wire format and socket helpers shared by the race server, the load generator
+// and the GUI client. Messages are a 4-byte header followed by a fixed-layout
+// payload, in host byte order, since races are only served over loopback and
+// Unix sockets. POSIX only.
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+const char *const RACE_DEFAULT_ADDRESS = "127.0.0.1:7070";
+const int RACE_MAX_PLAYERS = 64;    // per room
+const int RACE_MAX_KEYS = 256;      // per RACE_KEYS message
+const int RACE_STANDINGS_SHOWN = 8; // leaders sent to each player, plus their own row
+const int RACE_NAME_LENGTH = 16;
+
+enum RaceMessageType
+{
+    RACE_JOIN = 1,  // client: enter the next race of a mode, optionally in a named room
+    RACE_KEYS,      // client: a batch of typed codepoints, timestamped by the server on arrival
+    RACE_START,     // server: the race has started, with the passage to type
+    RACE_STANDINGS, // server: live standings of the player's race
+    RACE_FINISHED   // server: final standings were sent and the race is over
+};
+
+struct RaceHeader
+{
+    uint16_t type;
+    uint16_t length; // payload bytes after the header
+};
+static_assert(sizeof(RaceHeader) == 4, "race header layout");
+
+struct RaceJoin
+{
+    uint8_t mode; // 0 = Easy, 1 = Medium, 2 = Hard
+    uint8_t reserved[3];
+    char name[RACE_NAME_LENGTH];
+    char room[RACE_NAME_LENGTH]; // empty for the public race of the mode
+};
+static_assert(sizeof(RaceJoin) == 36, "race join layout");
+
+struct RaceStart
+{
+    uint32_t playerId;
+    uint32_t raceId;
+    uint32_t paragraph;
+    uint8_t mode;
+    uint8_t players;
+    uint16_t reserved;
+    float timeLimit;
+};
+static_assert(sizeof(RaceStart) == 20, "race start layout");
+
+struct RaceStanding
+{
+    uint32_t playerId;
+    uint32_t position; // characters typed correctly
+    uint16_t mistakes;
+    uint16_t wpmTenths;
+    uint8_t rank; // 1 for the leader
+    uint8_t finished;
+    uint16_t reserved;
+    char name[RACE_NAME_LENGTH];
+};
+static_assert(sizeof(RaceStanding) == 32, "race standing layout");
+
+// RACE_STANDINGS payload: this header, then count RaceStanding rows by rank
+struct RaceStandingsHeader
+{
+    uint32_t raceId;
+    uint8_t players;
+    uint8_t count;
+    uint16_t reserved;
+    float elapsed;
+};
+static_assert(sizeof(RaceStandingsHeader) == 12, "race standings layout");
+
+const int RACE_MAX_PAYLOAD = 1024;
+static_assert(RACE_MAX_KEYS * 4 <= RACE_MAX_PAYLOAD, "a full key batch fits in a message");
+static_assert(sizeof(RaceStandingsHeader) + (RACE_STANDINGS_SHOWN + 1) * sizeof(RaceStanding) <= RACE_MAX_PAYLOAD,
+              "full standings fit in a message");
+
+inline bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Thousands of connections need more descriptors than the usual soft limit
+inline void raiseFileLimit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Parses "unix:/path" or "host:port" (numeric IPv4) into a socket address
+inline bool parseRaceAddress(const char *address, sockaddr_storage &storage, socklen_t &length)
+{
+    memset(&storage, 0, sizeof(storage));
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        sockaddr_un *unixAddress = (sockaddr_un *)&storage;
+        const char *path = address + 5;
+        if (!*path || strlen(path) >= sizeof(unixAddress->sun_path))
+            return false;
+        unixAddress->sun_family = AF_UNIX;
+        strcpy(unixAddress->sun_path, path);
+        length = sizeof(sockaddr_un);
+        return true;
+    }
+
+    const char *colon = strrchr(address, ':');
+    if (!colon)
+        return false;
+    char host[64];
+    size_t hostLength = (size_t)(colon - address);
+    if (hostLength >= sizeof(host))
+        return false;
+    memcpy(host, address, hostLength);
+    host[hostLength] = '\0';
+
+    sockaddr_in *inetAddress = (sockaddr_in *)&storage;
+    inetAddress->sin_family = AF_INET;
+    inetAddress->sin_port = htons((uint16_t)atoi(colon + 1));
+    if (inet_pton(AF_INET, hostLength ? host : "127.0.0.1", &inetAddress->sin_addr) != 1)
+        return false;
+    length = sizeof(sockaddr_in);
+    return true;
+}
+
+// Returns a listening socket, or -1. A stale Unix socket file is replaced.
+inline int raceListen(const char *address)
+{
+    sockaddr_storage storage;
+    socklen_t length;
+    if (!parseRaceAddress(address, storage, length))
+        return -1;
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (storage.ss_family == AF_UNIX)
+    {
+        unlink(((sockaddr_un *)&storage)->sun_path);
+    }
+    else
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (bind(fd, (sockaddr *)&storage, length) != 0 || listen(fd, 1024) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Returns a connected, non-blocking socket, or -1
+inline int raceConnect(const char *address)
+{
+    sockaddr_storage storage;
+    socklen_t length;
+    if (!parseRaceAddress(address, storage, length))
+        return -1;
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (sockaddr *)&storage, length) != 0 || !setNonBlocking(fd))
+    {
+        close(fd);
+        return -1;
+    }
+#ifdef SO_NOSIGPIPE
+    // Where send() has no MSG_NOSIGNAL, a dropped connection must not raise SIGPIPE
+    int noSignal = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSignal, sizeof(noSignal));
+#endif
+    if (storage.ss_family == AF_INET)
+    {
+        // Key batches are small and latency matters more than packet count
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+// Buffered, non-blocking message I/O over one socket
+class RaceConnection
+{
+private:
+    static const size_t MAX_PENDING_OUTPUT = 64 * 1024; // a client this far behind is dropped
+    int fd;
+    std::vector<uint8_t> input;
+    size_t inputStart;
+    std::vector<uint8_t> output;
+    size_t outputStart;
+
+    // A peer that announces an oversized message is broken or hostile
+    bool isInputValid() const
+    {
+        if (input.size() - inputStart < sizeof(RaceHeader))
+            return true;
+        RaceHeader header;
+        memcpy(&header, input.data() + inputStart, sizeof(header));
+        return header.length <= RACE_MAX_PAYLOAD;
+    }
+
+public:
+    RaceConnection(int socketFd = -1) : fd(socketFd), inputStart(0), outputStart(0) {}
+    ~RaceConnection() { close(); }
+
+    RaceConnection(const RaceConnection &) = delete;
+    RaceConnection &operator=(const RaceConnection &) = delete;
+
+    int getFd() const { return fd; }
+    bool isOpen() const { return fd >= 0; }
+    bool hasPendingOutput() const { return outputStart < output.size(); }
+
+    void close()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        input.clear();
+        output.clear();
+        inputStart = outputStart = 0;
+    }
+
+    // Takes over an already connected socket
+    void open(int socketFd)
+    {
+        close();
+        fd = socketFd;
+    }
+
+    // Gives up the socket without closing it, e.g. to move it to another thread
+    int release()
+    {
+        int released = fd;
+        fd = -1;
+        return released;
+    }
+
+    // Queues a message; call flush() to send it. Returns false if the peer is too far behind.
+    bool send(RaceMessageType type, const void *payload, size_t length)
+    {
+        if (output.size() - outputStart + sizeof(RaceHeader) + length > MAX_PENDING_OUTPUT)
+            return false;
+        if (outputStart == output.size())
+        {
+            output.clear();
+            outputStart = 0;
+        }
+        RaceHeader header = {(uint16_t)type, (uint16_t)length};
+        const uint8_t *headerBytes = (const uint8_t *)&header;
+        output.insert(output.end(), headerBytes, headerBytes + sizeof(header));
+        output.insert(output.end(), (const uint8_t *)payload, (const uint8_t *)payload + length);
+        return true;
+    }
+
+    // Writes as much queued output as the socket takes. Returns false on a broken connection.
+    bool flush()
+    {
+        while (outputStart < output.size())
+        {
+            ssize_t written = ::send(fd, output.data() + outputStart, output.size() - outputStart, MSG_NOSIGNAL);
+            if (written < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            outputStart += (size_t)written;
+        }
+        output.clear();
+        outputStart = 0;
+        return true;
+    }
+
+    // Reads everything available. Returns false once the peer closed, the socket
+    // failed, or the peer sent a message longer than any valid one.
+    bool receive()
+    {
+        input.erase(input.begin(), input.begin() + inputStart);
+        inputStart = 0;
+        uint8_t buffer[4096];
+        for (;;)
+        {
+            ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (count > 0)
+            {
+                input.insert(input.end(), buffer, buffer + count);
+                continue;
+            }
+            if (count == 0)
+                return false;
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && isInputValid();
+        }
+    }
+
+    // Takes the next complete message out of the input buffer; payload stays valid
+    // until the next receive(). Returns false when no whole message is buffered.
+    bool next(RaceHeader &header, const uint8_t *&payload)
+    {
+        if (input.size() - inputStart < sizeof(RaceHeader))
+            return false;
+        memcpy(&header, input.data() + inputStart, sizeof(header));
+        if (input.size() - inputStart < sizeof(RaceHeader) + header.length)
+            return false;
+        payload = input.data() + inputStart + sizeof(RaceHeader);
+        inputStart += sizeof(RaceHeader) + header.length;
+        return true;
+    }
+
+    // Bytes received but not yet taken, e.g. to hand the connection to another thread
+    void takeInput(std::vector<uint8_t> &out)
+    {
+        out.assign(input.begin() + inputStart, input.end());
+        input.clear();
+        inputStart = 0;
+    }
+
+    void putInput(const std::vector<uint8_t> &bytes)
+    {
+        input.insert(input.end(), bytes.begin(), bytes.end());
+    }
+
+    // Bytes queued but not sent yet; a message may already be partly on the wire
+    void takeOutput(std::vector<uint8_t> &out)
+    {
+        out.assign(output.begin() + outputStart, output.end());
+        output.clear();
+        outputStart = 0;
+    }
+
+    // Queues bytes ahead of any message sent from now on
+    void putOutput(const std::vector<uint8_t> &bytes)
+    {
+        output.insert(output.end(), bytes.begin(), bytes.end());
+    }
+};
+
+inline void copyRaceName(char (&target)[RACE_NAME_LENGTH], const char *source)
+{
+    memset(target, 0, sizeof(target));
+    if (source)
+        memcpy(target, source, strnlen(source, RACE_NAME_LENGTH - 1));
+}
@@ -0,0 +1,105 @@
+#pragma once
+// Signed distance field font compiled into the binary. FontAtlas.h is generated
+// by fontgen (see README); without it the app uses raylib's default font.
+#include "raylib.h"
+
+#if defined(__has_include)
+#if __has_include("FontAtlas.h")
+#include "FontAtlas.h"
+#define TST_EMBEDDED_FONT
+#endif
+#endif
+
+// Turns the distance stored in the atlas into a sharp edge at any scale
+static const char *SDF_FRAGMENT_SHADER =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float distance = texture(texture0, fragTexCoord).r - 0.5;\n"
+    "    float width = max(fwidth(distance), 1e-4);\n"
+    "    float alpha = smoothstep(-width, width, distance);\n"
+    "    finalColor = vec4(fragColor.rgb, fragColor.a * alpha);\n"
+    "}\n";
+
+class SdfFont
+{
+private:
+    Font font;
+    Shader shader;
+    bool loaded;
+
+public:
+    SdfFont() : font(), shader(), loaded(false) {}
+
+    // Uploads the embedded atlas; needs the GL context and does no file I/O.
+    // Returns false when the binary was built without an atlas.
+    bool load()
+    {
+#ifdef TST_EMBEDDED_FONT
+        if (loaded)
+            return true;
+
+        Image atlas = {};
+        atlas.data = (void *)FONT_ATLAS_PIXELS;
+        atlas.width = FONT_ATLAS_WIDTH;
+        atlas.height = FONT_ATLAS_HEIGHT;
+        atlas.mipmaps = 1;
+        atlas.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE;
+        font.texture = LoadTextureFromImage(atlas);
+        SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);
+
+        // Allocated with raylib's allocator so UnloadFont() can free them
+        font.baseSize = FONT_ATLAS_BASE_SIZE;
+        font.glyphCount = FONT_ATLAS_GLYPH_COUNT;
+        font.glyphPadding = 0;
+        font.recs = (Rectangle *)MemAlloc(FONT_ATLAS_GLYPH_COUNT * sizeof(Rectangle));
+        font.glyphs = (GlyphInfo *)MemAlloc(FONT_ATLAS_GLYPH_COUNT * sizeof(GlyphInfo));
+        for (int i = 0; i < FONT_ATLAS_GLYPH_COUNT; i++)
+        {
+            const FontAtlasGlyph &glyph = FONT_ATLAS_GLYPHS[i];
+            font.recs[i] = Rectangle{(float)glyph.x, (float)glyph.y, (float)glyph.width, (float)glyph.height};
+            font.glyphs[i].value = glyph.codepoint;
+            font.glyphs[i].offsetX = glyph.offsetX;
+            font.glyphs[i].offsetY = glyph.offsetY;
+            font.glyphs[i].advanceX = glyph.advanceX;
+            font.glyphs[i].image = Image{};
+        }
+
+        shader = LoadShaderFromMemory(nullptr, SDF_FRAGMENT_SHADER);
+        loaded = true;
+#endif
+        return loaded;
+    }
+
+    void unload()
+    {
+        if (!loaded)
+            return;
+        UnloadShader(shader);
+        UnloadFont(font);
+        font = Font{};
+        loaded = false;
+    }
+
+    bool isLoaded() { return loaded; }
+    const Font &getFont() { return font; }
+
+    // Text drawn between begin() and end() goes through the SDF shader. Plain
+    // shapes are unaffected: raylib's white texel reads as fully inside, and the
+    // edge width is clamped since it is 0 across a flat texture.
+    void begin()
+    {
+        if (loaded)
+            BeginShaderMode(shader);
+    }
+
+    void end()
+    {
+        if (loaded)
+            EndShaderMode();
+    }
+};
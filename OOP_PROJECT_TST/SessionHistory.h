@@ -0,0 +1,212 @@
+#pragma once
+// Persistent session history: every finished session is appended to a record
+// file, and a small memory-mapped summary keeps per-mode aggregates and a top-K
+// leaderboard up to date, so neither startup nor queries rescan the records.
+#include "MappedFile.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+const uint32_t HISTORY_MAGIC = 0x48545354; // "TSTH"
+const uint32_t HISTORY_VERSION = 2; // 2: summaries skip sessions that took no time
+const int HISTORY_MODES = 4;      // Easy, Medium, Hard, Marathon
+const int HISTORY_WPM_BINS = 256; // 1 WPM wide, the last bin holds everything faster
+const int HISTORY_TOP_K = 10;
+
+struct SessionRecord
+{
+    int64_t timestamp; // seconds since the epoch
+    uint32_t paragraph;
+    uint32_t mistakes;
+    float wpm;
+    float cpm;
+    float accuracy;
+    float duration; // seconds
+    uint8_t mode;
+    uint8_t completed; // 1 if the text was finished, 0 if time ran out
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+struct LeaderboardEntry
+{
+    float wpm;
+    float accuracy;
+    uint64_t recordIndex; // position of the session in the record file
+};
+
+struct ModeSummary
+{
+    uint32_t count;
+    float bestWPM;
+    double sumWPM;
+    double sumAccuracy;
+    uint32_t wpmHistogram[HISTORY_WPM_BINS];
+    uint32_t topCount;
+    LeaderboardEntry top[HISTORY_TOP_K]; // fastest first
+};
+
+struct HistorySummary
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t recordCount; // records already folded into the aggregates
+    ModeSummary modes[HISTORY_MODES];
+};
+
+static_assert(sizeof(SessionRecord) == 40, "session records must stay 40 bytes");
+
+class SessionHistory
+{
+private:
+    const char *recordPath;
+    MappedFile summaryFile;
+    HistorySummary *summary;
+    FILE *records;
+
+    void fold(const SessionRecord &record, uint64_t index)
+    {
+        if (record.mode >= HISTORY_MODES)
+            return;
+        // Sessions that took no time have no meaningful speed; older builds stored inf or NaN for them
+        if (!(record.duration > 0) || !std::isfinite(record.wpm) || !std::isfinite(record.accuracy))
+            return;
+        ModeSummary &mode = summary->modes[record.mode];
+        mode.count++;
+        mode.sumWPM += record.wpm;
+        mode.sumAccuracy += record.accuracy;
+        if (mode.count == 1 || record.wpm > mode.bestWPM)
+            mode.bestWPM = record.wpm;
+        int bin = !(record.wpm > 0) ? 0 : (record.wpm >= HISTORY_WPM_BINS ? HISTORY_WPM_BINS - 1 : (int)record.wpm);
+        mode.wpmHistogram[bin]++;
+
+        // Insert into the sorted leaderboard, dropping the slowest entry if it is full
+        int slot = (int)mode.topCount;
+        while (slot > 0 && mode.top[slot - 1].wpm < record.wpm)
+        {
+            if (slot < HISTORY_TOP_K)
+                mode.top[slot] = mode.top[slot - 1];
+            slot--;
+        }
+        if (slot < HISTORY_TOP_K)
+        {
+            mode.top[slot] = LeaderboardEntry{record.wpm, record.accuracy, index};
+            if (mode.topCount < (uint32_t)HISTORY_TOP_K)
+                mode.topCount++;
+        }
+    }
+
+    // Folds in records the summary has not seen yet, e.g. after a crash between
+    // appending a record and updating the summary; a fresh summary reads them all
+    void catchUp()
+    {
+        FILE *input = fopen(recordPath, "rb");
+        if (!input)
+            return;
+        fseek(input, 0, SEEK_END);
+        uint64_t available = (uint64_t)ftell(input) / sizeof(SessionRecord);
+        if (available < summary->recordCount)
+        {
+            // The record file was replaced or truncated: start over
+            memset(summary->modes, 0, sizeof(summary->modes));
+            summary->recordCount = 0;
+        }
+        fseek(input, (long)(summary->recordCount * sizeof(SessionRecord)), SEEK_SET);
+        SessionRecord record;
+        while (summary->recordCount < available && fread(&record, sizeof(record), 1, input) == 1)
+        {
+            fold(record, summary->recordCount);
+            summary->recordCount++;
+        }
+        fclose(input);
+    }
+
+public:
+    SessionHistory(const char *recordFilePath)
+        : recordPath(recordFilePath), summary(nullptr), records(nullptr)
+    {
+    }
+
+    ~SessionHistory()
+    {
+        if (records)
+            fclose(records);
+    }
+
+    SessionHistory(const SessionHistory &) = delete;
+    SessionHistory &operator=(const SessionHistory &) = delete;
+
+    bool open(const char *summaryPath)
+    {
+        bool created;
+        summary = nullptr;
+        if (!summaryFile.openWritable(summaryPath, sizeof(HistorySummary), created))
+            return false;
+
+        summary = (HistorySummary *)summaryFile.getWritableData();
+        if (created || summary->magic != HISTORY_MAGIC || summary->version != HISTORY_VERSION)
+        {
+            memset(summary, 0, sizeof(HistorySummary));
+            summary->magic = HISTORY_MAGIC;
+            summary->version = HISTORY_VERSION;
+        }
+        catchUp();
+        return true;
+    }
+
+    bool isOpen() const { return summary != nullptr; }
+
+    void add(const SessionRecord &record)
+    {
+        if (!summary)
+            return;
+        if (!records)
+            records = fopen(recordPath, "ab");
+        if (!records || fwrite(&record, sizeof(record), 1, records) != 1)
+            return;
+        fflush(records);
+
+        // The record is on disk first, so the summary never counts a missing one
+        fold(record, summary->recordCount);
+        summary->recordCount++;
+    }
+
+    const ModeSummary *getMode(int mode) const
+    {
+        if (!summary || mode < 0 || mode >= HISTORY_MODES)
+            return nullptr;
+        return &summary->modes[mode];
+    }
+
+    float getMeanWPM(int mode) const
+    {
+        const ModeSummary *stats = getMode(mode);
+        return stats && stats->count ? (float)(stats->sumWPM / stats->count) : 0;
+    }
+
+    float getMeanAccuracy(int mode) const
+    {
+        const ModeSummary *stats = getMode(mode);
+        return stats && stats->count ? (float)(stats->sumAccuracy / stats->count) : 0;
+    }
+
+    // WPM at the given fraction (0..1) of sessions, to 1 WPM resolution
+    float getPercentileWPM(int mode, float fraction) const
+    {
+        const ModeSummary *stats = getMode(mode);
+        if (!stats || stats->count == 0)
+            return 0;
+        uint32_t target = (uint32_t)(fraction * stats->count);
+        if (target < 1)
+            target = 1;
+        uint32_t seen = 0;
+        for (int bin = 0; bin < HISTORY_WPM_BINS; bin++)
+        {
+            seen += stats->wpmHistogram[bin];
+            if (seen >= target)
+                return (float)bin;
+        }
+        return (float)(HISTORY_WPM_BINS - 1);
+    }
+};
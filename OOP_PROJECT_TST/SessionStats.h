@@ -0,0 +1,155 @@
+#pragma once
+// Live session statistics, updated in constant time per keystroke
+#include <algorithm>
+#include <cmath>
+
+// Correct characters typed over the last few seconds, kept in a ring of time buckets
+class RollingWPM
+{
+private:
+    static constexpr int BUCKETS = 40;
+    static constexpr double BUCKET_SECONDS = 0.25; // 10 second window
+    int counts[BUCKETS];
+    int windowSum;
+    long long headBucket; // absolute index of the newest bucket
+    double origin;
+
+    // Moves the window forward to time t, dropping buckets that fell out of it
+    void advance(double t)
+    {
+        long long bucket = (long long)std::floor((t - origin) / BUCKET_SECONDS);
+        if (bucket <= headBucket)
+            return;
+        long long steps = std::min(bucket - headBucket, (long long)BUCKETS);
+        for (long long i = 1; i <= steps; i++)
+        {
+            int index = (int)((headBucket + i) % BUCKETS);
+            windowSum -= counts[index];
+            counts[index] = 0;
+        }
+        headBucket = bucket;
+    }
+
+public:
+    RollingWPM() { reset(0); }
+
+    static double windowSeconds() { return BUCKETS * BUCKET_SECONDS; }
+
+    void reset(double startTime)
+    {
+        std::fill(counts, counts + BUCKETS, 0);
+        windowSum = 0;
+        headBucket = 0;
+        origin = startTime;
+    }
+
+    void addCharacter(double t)
+    {
+        advance(t);
+        counts[headBucket % BUCKETS]++;
+        windowSum++;
+    }
+
+    float getWPM(double now)
+    {
+        advance(now);
+        // Early in a session the window is only as long as the session so far
+        double span = std::max(1.0, std::min(windowSeconds(), now - origin));
+        return (float)((windowSum / 5.0) / (span / 60.0));
+    }
+};
+
+// Inter-key latencies in fixed 5 ms buckets up to 2 s, plus one overflow bucket
+class LatencyHistogram
+{
+private:
+    static constexpr int BUCKETS = 400;
+    static constexpr int BUCKET_MS = 5;
+    int counts[BUCKETS + 1];
+    int total;
+    // Percentiles are recomputed lazily, at most once per new sample
+    int cachedTotal;
+    float cachedP50, cachedP95, cachedP99;
+
+    float percentileUncached(float fraction) const
+    {
+        int target = (int)std::ceil(fraction * total);
+        int seen = 0;
+        for (int i = 0; i <= BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen >= target)
+                return (float)((i + 1) * BUCKET_MS); // upper edge of the bucket
+        }
+        return (float)(BUCKETS * BUCKET_MS);
+    }
+
+    void refresh()
+    {
+        if (cachedTotal == total)
+            return;
+        cachedP50 = percentileUncached(0.50f);
+        cachedP95 = percentileUncached(0.95f);
+        cachedP99 = percentileUncached(0.99f);
+        cachedTotal = total;
+    }
+
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset()
+    {
+        std::fill(counts, counts + BUCKETS + 1, 0);
+        total = 0;
+        cachedTotal = 0;
+        cachedP50 = cachedP95 = cachedP99 = 0;
+    }
+
+    void add(double seconds)
+    {
+        int bucket = (int)(seconds * 1000.0 / BUCKET_MS);
+        counts[std::max(0, std::min(bucket, BUCKETS))]++;
+        total++;
+    }
+
+    int getCount() const { return total; }
+
+    // Percentiles in milliseconds, 0 while there are no samples
+    float getP50() { refresh(); return cachedP50; }
+    float getP95() { refresh(); return cachedP95; }
+    float getP99() { refresh(); return cachedP99; }
+};
+
+class SessionStats
+{
+private:
+    RollingWPM rolling;
+    LatencyHistogram latency;
+    double lastKeyTime;
+    bool hasKey;
+
+public:
+    SessionStats() : lastKeyTime(0), hasKey(false) {}
+
+    void reset(double startTime)
+    {
+        rolling.reset(startTime);
+        latency.reset();
+        lastKeyTime = startTime;
+        hasKey = false;
+    }
+
+    void onKey(double keyTime, bool correct)
+    {
+        // The first key measures reaction time, not typing rhythm
+        if (hasKey)
+            latency.add(keyTime - lastKeyTime);
+        lastKeyTime = keyTime;
+        hasKey = true;
+        if (correct)
+            rolling.addCharacter(keyTime);
+    }
+
+    float getRollingWPM(double now) { return rolling.getWPM(now); }
+    LatencyHistogram &getLatency() { return latency; }
+};
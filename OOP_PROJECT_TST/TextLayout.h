@@ -0,0 +1,140 @@
+#pragma once
+// Word wrapping of a decoded passage, independent of raylib so it can be
+// measured and benchmarked headless
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Precomputed screen position of one word of the current paragraph
+struct WordLayout
+{
+    int start;      // index of the first character in the text
+    int end;        // index one past the last character
+    int x;
+    int line;
+    int width;
+    int painted;    // paint key (state and mistake count) the word has in the paragraph texture, -1 if none
+};
+
+// First character and first word of one wrapped line
+struct LineLayout
+{
+    int start;
+    int firstWord;
+};
+
+// Advance width of every glyph of a font, looked up by codepoint in constant
+// time, so laying out a word never has to search the font or decode UTF-8
+class GlyphAdvances
+{
+private:
+    static const int DIRECT_CODEPOINTS = 0x800; // Latin, Greek, Cyrillic, Hebrew, Arabic...
+    std::vector<float> direct;
+    std::vector<std::pair<int, float>> others; // sorted by codepoint
+    float fallback;                            // raylib draws '?' for missing glyphs
+    int baseSize;
+
+public:
+    GlyphAdvances() : fallback(0), baseSize(1) {}
+
+    bool isBuilt() const { return !direct.empty(); }
+
+    // Starts a new table; add() every glyph, then finish()
+    void reset(int fontBaseSize)
+    {
+        direct.assign(DIRECT_CODEPOINTS, -1.0f);
+        others.clear();
+        fallback = 0;
+        baseSize = fontBaseSize > 0 ? fontBaseSize : 1;
+    }
+
+    void add(int codepoint, float advance)
+    {
+        if (codepoint == '?')
+            fallback = advance;
+        if (codepoint >= 0 && codepoint < DIRECT_CODEPOINTS)
+            direct[codepoint] = advance;
+        else
+            others.push_back(std::make_pair(codepoint, advance));
+    }
+
+    void finish()
+    {
+        std::sort(others.begin(), others.end());
+        for (float &advance : direct)
+        {
+            if (advance < 0)
+                advance = fallback;
+        }
+    }
+
+    // Advance at the font's base size
+    float get(int codepoint) const
+    {
+        if (codepoint >= 0 && codepoint < DIRECT_CODEPOINTS)
+            return direct[codepoint];
+        auto it = std::lower_bound(others.begin(), others.end(), std::make_pair(codepoint, 0.0f));
+        return it != others.end() && it->first == codepoint ? it->second : fallback;
+    }
+
+    // Width of count codepoints drawn at fontSize, as MeasureTextEx would report it
+    float measure(const int *codepoints, int count, float fontSize, float spacing) const
+    {
+        if (count <= 0)
+            return 0;
+        float width = 0;
+        for (int i = 0; i < count; i++)
+            width += get(codepoints[i]);
+        return width * fontSize / baseSize + (count - 1) * spacing;
+    }
+};
+
+// Splits text into words at spaces and wraps them into lines running from left
+// to right. Reuses the capacity of words and lines. Returns the width of a space.
+inline int layoutWords(const int *text, int length, const GlyphAdvances &glyphs, float fontSize, float spacing,
+                       int left, int right, std::vector<WordLayout> &words, std::vector<LineLayout> &lines)
+{
+    int space = ' ';
+    int spaceWidth = (int)glyphs.measure(&space, 1, fontSize, spacing);
+
+    words.clear();
+    lines.clear();
+
+    int currentX = left;
+    int currentLine = 0;
+    int i = 0;
+    while (i < length)
+    {
+        if (text[i] == ' ')
+        {
+            i++;
+            continue;
+        }
+
+        WordLayout word;
+        word.start = i;
+        while (i < length && text[i] != ' ')
+            i++;
+        word.end = i;
+
+        int wordWidth = (int)glyphs.measure(text + word.start, word.end - word.start, fontSize, spacing);
+        if (lines.empty())
+        {
+            lines.push_back(LineLayout{0, 0});
+        }
+        else if (currentX + wordWidth > right)
+        {
+            currentX = left;
+            currentLine++;
+            lines.push_back(LineLayout{word.start, (int)words.size()});
+        }
+        word.x = currentX;
+        word.line = currentLine;
+        word.width = wordWidth;
+        word.painted = -1;
+        words.push_back(word);
+
+        currentX += wordWidth + spaceWidth;
+    }
+    return spaceWidth;
+}
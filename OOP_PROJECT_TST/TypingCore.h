@@ -0,0 +1,557 @@
+#pragma once
+// Typing session core: scoring and timing without any dependency on raylib,
+// so sessions can run headless with any time source.
+#include "KeystrokeLog.h"
+#include "ParagraphCorpus.h"
+#include "SessionStats.h"
+#include "SessionHistory.h"
+#include "Drill.h"
+#include "ErrorMap.h"
+#include "Utf8.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+// Source of the current time in seconds, injected into every TextMode
+class Clock
+{
+public:
+    virtual ~Clock() {}
+    virtual double now() = 0;
+};
+
+// Monotonic wall clock, used when no other clock is set
+class SteadyClock : public Clock
+{
+public:
+    double now() override
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// Clock that only moves when told to, for replaying or simulating sessions
+class ManualClock : public Clock
+{
+private:
+    double time;
+
+public:
+    ManualClock() : time(0) {}
+
+    double now() override { return time; }
+    void set(double t) { time = t; }
+    void advance(double seconds) { time += seconds; }
+};
+
+// Uniform index in [0, count), also for counts above a 15-bit RAND_MAX
+inline int randomIndex(int count)
+{
+    unsigned int value = ((unsigned int)rand() << 15) ^ (unsigned int)rand();
+    return (int)(value % (unsigned int)count);
+}
+
+// Base class / parent class
+class TextMode
+{
+protected:
+    const char *text;       // the passage as UTF-8
+    std::vector<int> codepoints; // the passage decoded once, textLength entries
+    int textLength;
+    int currentPosition;
+    int mistakes;
+    ErrorBitmap errors; // positions that were mistyped at least once
+    double startTime;
+    bool isTyping;
+    bool isTimeUp;
+    bool isStarted;
+    const char *paragraphs[10];
+    int currentParagraph;
+    float finalWPM;
+    float finalCPM;
+    float finalAccuracy;
+    bool isCompleted;
+    float completionTime;
+    Clock *clock;
+    KeystrokeLog *keyLog;
+    const ParagraphCorpus *corpus;
+    float timeLimit; // seconds, 0 for untimed sessions
+    SessionStats stats;
+    SessionHistory *history;
+    WeaknessModel *weakness;
+    DrillIndex drillIndex;
+    double previousKeyTime;
+    bool previousKeyCorrect;
+    std::vector<std::pair<uint64_t, float>> weakBigrams;
+    std::vector<int> drillCandidates;
+
+    // Decodes a new passage; positions and lengths from here on count codepoints
+    void setText(const char *newText, int byteLength)
+    {
+        text = newText;
+        decodeUtf8(newText, byteLength, codepoints);
+        textLength = (int)codepoints.size();
+    }
+
+    // Clears all progress so the current text can be typed from the start
+    void resetSession()
+    {
+        if (keyLog)
+            keyLog->endSession();
+        currentPosition = 0;
+        mistakes = 0;
+        errors.reset(textLength);
+        isTyping = false;
+        isTimeUp = false;
+        isStarted = false;
+        isCompleted = false;
+        finalWPM = 0;
+        finalCPM = 0;
+        finalAccuracy = 0;
+        completionTime = 0;
+    }
+
+    // Ends the session after the text was finished or time ran out
+    void finishSession(float duration)
+    {
+        completionTime = duration;
+        calculateFinalStats();
+        if (keyLog)
+            keyLog->endSession(isCompleted ? KEYLOG_COMPLETED : KEYLOG_TIMED_OUT);
+        // Sessions that timed out without a single key are not worth keeping
+        if (history && currentPosition + mistakes > 0)
+        {
+            SessionRecord record = {};
+            record.timestamp = (int64_t)time(nullptr);
+            record.paragraph = (uint32_t)currentParagraph;
+            record.mistakes = (uint32_t)mistakes;
+            record.wpm = finalWPM;
+            record.cpm = finalCPM;
+            record.accuracy = finalAccuracy;
+            record.duration = completionTime;
+            record.mode = (uint8_t)getModeId();
+            record.completed = isCompleted ? 1 : 0;
+            history->add(record);
+        }
+    }
+
+    static Clock *defaultClock()
+    {
+        static SteadyClock steadyClock;
+        return &steadyClock;
+    }
+
+public:
+    TextMode() : currentPosition(0), mistakes(0), startTime(0), isTyping(false),
+                 isTimeUp(false), isStarted(false), currentParagraph(0),
+                 finalWPM(0), finalCPM(0), finalAccuracy(0), isCompleted(false),
+                 completionTime(0), clock(defaultClock()), keyLog(nullptr),
+                 corpus(nullptr), timeLimit(30.0f), history(nullptr),
+                 weakness(nullptr), previousKeyTime(0), previousKeyCorrect(false)
+    {
+    }
+    virtual ~TextMode()
+    {
+        if (keyLog)
+            keyLog->endSession();
+    }
+
+    // 0 = Easy, 1 = Medium, 2 = Hard
+    virtual int getModeId() { return 0; }
+
+    virtual const char *getText() { return text; }
+    virtual int getLength() { return textLength; }
+    const int *getCodepoints() { return codepoints.data(); }
+    virtual int getCurrentPosition() { return currentPosition; }
+    virtual int getMistakes() { return mistakes; }
+    const ErrorBitmap &getErrors() { return errors; }
+    virtual double getStartTime() { return startTime; }
+    virtual bool getIsTyping() { return isTyping; }
+    virtual bool getIsTimeUp() { return isTimeUp; }
+    virtual bool getIsStarted() { return isStarted; }
+    virtual bool getIsCompleted() { return isCompleted; }
+    virtual float getCompletionTime() { return completionTime; }
+    virtual int getCurrentParagraph() { return currentParagraph; }
+    virtual float getTimeLimit() { return timeLimit; }
+
+    void setClock(Clock *newClock) { clock = newClock ? newClock : defaultClock(); }
+    Clock *getClock() { return clock; }
+
+    // Every key checked while a session runs is recorded into the log
+    void setKeystrokeLog(KeystrokeLog *log) { keyLog = log; }
+
+    // Every finished session is added to the history
+    void setHistory(SessionHistory *sessionHistory) { history = sessionHistory; }
+
+    // Paragraphs come from the corpus tier matching this mode when it has any,
+    // otherwise from the built-in table; takes effect on the next selection
+    void setCorpus(const ParagraphCorpus *newCorpus) { corpus = newCorpus; }
+
+    bool usesCorpus()
+    {
+        return corpus && corpus->isOpen() && getModeId() < CORPUS_TIERS && corpus->getTierCount(getModeId()) > 0;
+    }
+
+    virtual int getParagraphCount()
+    {
+        return usesCorpus() ? corpus->getTierCount(getModeId()) : 10;
+    }
+
+    // Mistakes and timings are fed into the model, and selectRandomParagraph()
+    // prefers passages full of the weakest bigrams once it has enough data
+    void setWeaknessModel(WeaknessModel *model) { weakness = model; }
+
+    // Indexes the bigrams of every paragraph this mode can pick, in the background
+    void buildDrillIndex()
+    {
+        const ParagraphCorpus *source = usesCorpus() ? corpus : nullptr;
+        int first = source ? corpus->getTierStart(getModeId()) : 0;
+        const char *const *table = paragraphs;
+        drillIndex.buildAsync(getParagraphCount(), [source, first, table](int index, int &length) -> const char *
+                              {
+                                  if (source)
+                                  {
+                                      length = source->getLength(first + index);
+                                      return source->getText(first + index);
+                                  }
+                                  length = (int)strlen(table[index]);
+                                  return table[index];
+                              });
+    }
+
+    bool isDrillIndexReady() const { return drillIndex.isReady(); }
+
+    virtual void startTyping()
+    {
+        if (!isTyping && isStarted)
+        {
+            isTyping = true;
+            startTime = clock->now();
+            isTimeUp = false;
+            isCompleted = false;
+            completionTime = 0;
+            stats.reset(startTime);
+            previousKeyTime = startTime;
+            previousKeyCorrect = false;
+            if (keyLog)
+                keyLog->beginSession(getModeId(), currentParagraph, startTime);
+        }
+    }
+
+    // keyTime is the moment the key was read from the input queue
+    virtual void checkInput(int key, double keyTime)
+    {
+        if (!isTyping || isTimeUp || !isStarted || isCompleted)
+            return;
+
+        if (timeLimit > 0 && keyTime - startTime >= timeLimit)
+        {
+            isTimeUp = true;
+            finishSession(timeLimit);
+            return;
+        }
+
+        int expected = codepoints[currentPosition];
+        bool correct = key == expected;
+        stats.onKey(keyTime, correct);
+        if (weakness && currentPosition > 0)
+        {
+            weakness->addKey(codepoints[currentPosition - 1], expected, correct,
+                             keyTime - previousKeyTime, previousKeyCorrect);
+        }
+        previousKeyTime = keyTime;
+        previousKeyCorrect = correct;
+        if (keyLog)
+            keyLog->record(key, expected, correct, keyTime);
+
+        if (correct)
+        {
+            currentPosition++;
+            if (currentPosition >= textLength)
+            {
+                isCompleted = true;
+                finishSession(keyTime - startTime);
+            }
+        }
+        else
+        {
+            mistakes++;
+            errors.set(currentPosition);
+        }
+    }
+
+    virtual void calculateFinalStats()
+    {
+        // Keys drained in one frame share a timestamp, so a session can end with no time elapsed
+        float timeInMinutes = completionTime / 60.0f;
+        finalWPM = completionTime > 0 ? (currentPosition / 5.0f) / timeInMinutes : 0;
+        finalCPM = completionTime > 0 ? currentPosition / timeInMinutes : 0;
+        finalAccuracy = currentPosition + mistakes == 0 ? 100 : ((float)currentPosition / (currentPosition + mistakes)) * 100;
+    }
+
+    virtual bool isComplete()
+    {
+        return isCompleted || isTimeUp;
+    }
+
+    virtual float getWPM()
+    {
+        if (!isTyping || !isStarted)
+            return 0;
+        if (isCompleted || isTimeUp)
+            return finalWPM;
+        float timeInMinutes = (clock->now() - startTime) / 60.0f;
+        return timeInMinutes > 0 ? (currentPosition / 5.0f) / timeInMinutes : 0;
+    }
+
+    virtual float getCPM()
+    {
+        if (!isTyping || !isStarted)
+            return 0;
+        if (isCompleted || isTimeUp)
+            return finalCPM;
+        float timeInMinutes = (clock->now() - startTime) / 60.0f;
+        return timeInMinutes > 0 ? currentPosition / timeInMinutes : 0;
+    }
+
+    // Speed over the last few seconds rather than since the start
+    virtual float getRollingWPM()
+    {
+        if (!isTyping || !isStarted)
+            return 0;
+        if (isCompleted || isTimeUp)
+            return finalWPM;
+        return stats.getRollingWPM(clock->now());
+    }
+
+    LatencyHistogram &getLatency() { return stats.getLatency(); }
+
+    virtual float getAccuracy()
+    {
+        if (currentPosition + mistakes == 0)
+            return 100;
+        if (isCompleted || isTimeUp)
+            return finalAccuracy;
+        return ((float)currentPosition / (currentPosition + mistakes)) * 100;
+    }
+
+    virtual void selectRandomParagraph()
+    {
+        // Drill the weakest bigrams when there is data, picking among the best few for variety
+        if (weakness && weakness->hasData() && drillIndex.isReady())
+        {
+            weakness->getWeakest(8, weakBigrams);
+            drillIndex.findPassages(weakBigrams, currentParagraph, 3, drillCandidates);
+            if (!drillCandidates.empty())
+            {
+                selectParagraph(drillCandidates[randomIndex((int)drillCandidates.size())]);
+                return;
+            }
+        }
+        selectParagraph(randomIndex(getParagraphCount()));
+    }
+
+    virtual void selectParagraph(int index)
+    {
+        currentParagraph = index;
+        const char *passage = nullptr;
+        if (usesCorpus())
+        {
+            int entry = corpus->getTierStart(getModeId()) + index;
+            passage = corpus->getText(entry);
+            if (passage)
+                setText(passage, corpus->getLength(entry));
+        }
+        if (!passage)
+        {
+            passage = paragraphs[currentParagraph % 10];
+            setText(passage, (int)strlen(passage));
+        }
+        resetSession();
+    }
+
+    virtual void updateTimer()
+    {
+        if (isTyping && !isTimeUp && isStarted && !isCompleted)
+        {
+            float elapsedTime = clock->now() - startTime;
+            if (timeLimit > 0 && elapsedTime >= timeLimit)
+            {
+                isTimeUp = true;
+                finishSession(timeLimit);
+            }
+        }
+    }
+
+    virtual float getRemainingTime()
+    {
+        if (!isTyping || !isStarted || isCompleted)
+            return timeLimit;
+        if (isTimeUp)
+            return 0;
+        float elapsedTime = clock->now() - startTime;
+        return (timeLimit - elapsedTime) > 0 ? (timeLimit - elapsedTime) : 0;
+    }
+
+    virtual float getElapsedTime()
+    {
+        if (!isTyping || !isStarted)
+            return 0;
+        if (isCompleted || isTimeUp)
+            return completionTime;
+        return clock->now() - startTime;
+    }
+
+    virtual void startGame()
+    {
+        isStarted = true;
+        startTyping();
+    }
+};
+
+class EasyMode : public TextMode
+{
+public:
+    int getModeId() override { return 0; }
+
+    EasyMode()
+    {
+        paragraphs[0] = "The quick brown fox jumps over the lazy dog. This is a simple test for typing speed. Learning to type quickly and accurately is an important skill. The sun rises in the east and sets in the west. Practice makes perfect in everything we do.";
+        paragraphs[1] = "A good typing speed helps you work more efficiently. The keyboard is your tool for digital communication. Typing is a skill that everyone should learn. Computers are powerful tools in our daily lives. Speed and accuracy are both important when typing.";
+        paragraphs[2] = "The internet has changed how we work and communicate. Good typing skills are essential for success. Computers are everywhere in our modern world. Being able to type well makes everything easier. Practice every day to improve your skills.";
+        paragraphs[3] = "Typing is like playing a musical instrument. Start slow and focus on accuracy first. Use all your fingers when typing. Keep your eyes on the screen, not the keyboard. This will help you type faster with fewer mistakes.";
+        paragraphs[4] = "The home row keys are the foundation of good typing. Your fingers should rest on ASDF and JKL. From there, you can reach all other keys. Practice typing without looking at the keyboard. This is called touch typing.";
+        paragraphs[5] = "Regular practice is the key to improving your typing. Set aside time each day to practice. Use online typing tests to measure progress. Try to beat your previous scores. Remember that accuracy is more important than speed.";
+        paragraphs[6] = "Good posture is important when typing for long periods. Sit up straight with your feet flat on the floor. Keep your wrists straight and fingers curved. Take breaks often to rest your hands. Comfort is important for good typing.";
+        paragraphs[7] = "The QWERTY keyboard layout was designed long ago. It was made to prevent typewriter keys from jamming. Today, we still use this layout for computers. Some people use different layouts like Dvorak. But QWERTY is the most common.";
+        paragraphs[8] = "Typing games can make practice fun and engaging. They help you learn while having fun. Many websites offer free typing games. Some track your progress over time. Playing these games can improve your skills.";
+        paragraphs[9] = "In today's world, typing is a basic skill everyone needs. Many jobs require good typing skills. Schools teach typing to prepare students. The faster you can type, the more productive you can be. It's a skill that will help you throughout life.";
+        selectRandomParagraph();
+    }
+};
+
+class MediumMode : public TextMode
+{
+public:
+    int getModeId() override { return 1; }
+
+    MediumMode()
+    {
+        paragraphs[0] = "Programming creates computer instructions using various languages. Each language has unique syntax and rules. Understanding these rules is essential for coding. Practice helps develop programming skills. Good programmers write clean, efficient code.";
+        paragraphs[1] = "Computer science studies computers and computational systems. It combines theory and practical applications. Computer scientists develop new technologies. The field evolves with new innovations. Understanding CS is vital for modern technology.";
+        paragraphs[2] = "Algorithms are step-by-step problem-solving procedures. They are fundamental to programming. Good algorithms are efficient and correct. Understanding algorithms improves coding skills. Many problems use standard algorithms.";
+        paragraphs[3] = "Data structures organize and store computer data. They enable efficient data access. Common structures include arrays and lists. Choosing the right structure is crucial. Understanding structures is key to programming.";
+        paragraphs[4] = "Software development creates computer programs. It involves coding and testing. Good software is reliable and user-friendly. The process includes planning and maintenance. Teamwork is important in development.";
+        paragraphs[5] = "The internet is a global network of computers. It enables information sharing worldwide. The web contains websites and pages. Understanding the internet is crucial. Security is vital for internet usage.";
+        paragraphs[6] = "Artificial intelligence simulates human intelligence. It includes learning and reasoning. AI systems perform complex tasks. Machine learning is an AI subset. AI is important in modern technology.";
+        paragraphs[7] = "Cybersecurity protects systems from digital attacks. It's crucial in our connected world. Good security prevents data breaches. Understanding security is important. Strong passwords are essential.";
+        paragraphs[8] = "Cloud computing provides resources over the internet. It offers flexibility and scalability. Users access data from anywhere. Cloud services are popular. Understanding cloud computing is important.";
+        paragraphs[9] = "Mobile apps are essential in daily life. They help communication and work. Developing apps requires platform knowledge. Good apps are user-friendly. The app market continues growing.";
+        selectRandomParagraph();
+    }
+};
+
+class HardMode : public TextMode
+{
+public:
+    int getModeId() override { return 2; }
+
+    HardMode()
+    {
+        paragraphs[0] = "OOP utilizes encapsulation, inheritance, and polymorphism. Classes define object types and behaviors. Inheritance creates hierarchical relationships. Polymorphism enables flexible object handling. Abstraction hides complex details.";
+        paragraphs[1] = "Machine learning processes vast datasets, identifying patterns. Deep learning excels at image recognition. NLP analyzes linguistic structures. Reinforcement learning optimizes decisions. These technologies revolutionize automation.";
+        paragraphs[2] = "Quantum computing uses superposition and entanglement. Qubits exist in multiple states. Quantum algorithms solve problems faster. Decoherence challenges quantum states. Error correction mitigates quantum noise.";
+        paragraphs[3] = "Blockchain uses cryptographic hashing and signatures. Smart contracts execute automatically. Consensus mechanisms validate transactions. Distributed ledgers maintain records. Cryptocurrencies use blockchain securely.";
+        paragraphs[4] = "Neural networks process through artificial neurons. Backpropagation adjusts connection weights. Activation functions add non-linearity. Convolutional layers extract features. Recurrent networks handle sequences.";
+        paragraphs[5] = "IoT integrates sensors and protocols. Edge computing reduces latency. Security needs encryption. Standards ensure device communication. Predictive maintenance uses IoT data.";
+        paragraphs[6] = "VR uses displays and motion tracking. Haptic feedback enhances interaction. Spatial audio simulates sound. Latency reduction prevents sickness. VR spans training and entertainment.";
+        paragraphs[7] = "AR overlays digital information. Tracking systems enable interactions. Vision algorithms detect objects. Displays project virtual content. AR aids navigation and education.";
+        paragraphs[8] = "Big data processes high-velocity datasets. MapReduce parallelizes processing. NoSQL handles unstructured data. Mining extracts insights. Privacy techniques protect information.";
+        paragraphs[9] = "Cybersecurity uses defense-in-depth strategies. IDS monitors network traffic. Cryptography secures communication. Zero-trust verifies access. Response plans handle breaches.";
+        selectRandomParagraph();
+    }
+};
+
+// Untimed session over one long text loaded from a file, for marathon practice
+class MarathonMode : public TextMode
+{
+private:
+    std::string marathonText;
+
+public:
+    int getModeId() override { return 3; }
+
+    MarathonMode()
+    {
+        timeLimit = 0;
+        text = "";
+        textLength = 0;
+    }
+
+    // Loads a plain text file; line breaks and runs of whitespace become single spaces
+    bool load(const char *path)
+    {
+        FILE *file = fopen(path, "rb");
+        if (!file)
+            return false;
+
+        marathonText.clear();
+        bool pendingSpace = false;
+        int c;
+        while ((c = fgetc(file)) != EOF)
+        {
+            if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+            {
+                pendingSpace = !marathonText.empty();
+                continue;
+            }
+            if (pendingSpace)
+                marathonText.push_back(' ');
+            marathonText.push_back((char)c);
+            pendingSpace = false;
+        }
+        fclose(file);
+
+        selectParagraph(0);
+        return !marathonText.empty();
+    }
+
+    bool isLoaded() { return !marathonText.empty(); }
+
+    int getParagraphCount() override { return isLoaded() ? 1 : 0; }
+
+    void selectRandomParagraph() override { selectParagraph(0); }
+
+    void selectParagraph(int index) override
+    {
+        currentParagraph = index;
+        setText(marathonText.c_str(), (int)marathonText.size());
+        resetSession();
+    }
+};
+
+// Re-scores one logged session on the mode it was typed in, timed by clock. A
+// session that ran out of time is run to its time limit, as it was live, rather
+// than stopped at its last key.
+inline void replaySession(TextMode &mode, ManualClock &clock, const KeystrokeSession &session)
+{
+    mode.setClock(&clock);
+    mode.selectParagraph(session.paragraph);
+    clock.set(0);
+    mode.startGame();
+    for (const auto &block : session.blocks)
+    {
+        for (uint32_t i = 0; i < block.second; i++)
+        {
+            const KeystrokeRecord &key = block.first[i];
+            clock.advance(key.getDeltaMicros() / 1000000.0);
+            mode.checkInput((int)key.codepoint, clock.now());
+        }
+    }
+    if (session.outcome == KEYLOG_TIMED_OUT && mode.getTimeLimit() > 0 && clock.now() < mode.getTimeLimit())
+        clock.set(mode.getTimeLimit());
+    mode.updateTimer();
+}
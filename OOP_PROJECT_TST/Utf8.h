@@ -0,0 +1,66 @@
+#pragma once
+// UTF-8 decoding, done once when a passage is loaded
+#include <vector>
+
+const int REPLACEMENT_CHARACTER = 0xFFFD;
+
+// Decodes the codepoint starting at text[i] (i < length) and advances i past it.
+// Malformed or truncated sequences decode to U+FFFD one byte at a time.
+inline int decodeUtf8(const char *text, int length, int &i)
+{
+    unsigned char lead = (unsigned char)text[i++];
+    if (lead < 0x80)
+        return lead;
+
+    int extra;
+    int codepoint;
+    int minimum;
+    if ((lead & 0xE0) == 0xC0)
+    {
+        extra = 1;
+        codepoint = lead & 0x1F;
+        minimum = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        extra = 2;
+        codepoint = lead & 0x0F;
+        minimum = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        extra = 3;
+        codepoint = lead & 0x07;
+        minimum = 0x10000;
+    }
+    else
+    {
+        return REPLACEMENT_CHARACTER;
+    }
+
+    if (i + extra > length)
+        return REPLACEMENT_CHARACTER;
+    for (int k = 0; k < extra; k++)
+    {
+        unsigned char next = (unsigned char)text[i + k];
+        if ((next & 0xC0) != 0x80)
+            return REPLACEMENT_CHARACTER;
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    // Overlong forms, surrogates and values past U+10FFFF are rejected
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        return REPLACEMENT_CHARACTER;
+
+    i += extra;
+    return codepoint;
+}
+
+// Replaces out with the codepoints of the first length bytes of text; keeps its capacity
+inline void decodeUtf8(const char *text, int length, std::vector<int> &out)
+{
+    out.clear();
+    out.reserve(length);
+    int i = 0;
+    while (i < length)
+        out.push_back(decodeUtf8(text, length, i));
+}
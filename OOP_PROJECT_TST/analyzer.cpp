@@ -0,0 +1,304 @@
+// Offline analyzer for keystroke logs written by the typing tracker.
+// Each log file is treated as one user. Files are split into chunks of whole
+// sessions that worker threads read straight from the memory mapping, each into
+// its own partial statistics; the partials are merged once all chunks are done.
+#include "KeystrokeLog.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int CHAR_SLOTS = 257; // codepoints 0-255, then one slot for everything above
+const size_t CHUNK_BYTES = 4 << 20;
+
+int charSlot(uint32_t codepoint)
+{
+    return codepoint < 256 ? (int)codepoint : 256;
+}
+
+struct UserStats
+{
+    uint64_t sessions;
+    uint64_t keys;
+    uint64_t correct;
+    double seconds;
+    // Least-squares fit of session WPM against session number, for the speed trend.
+    // Sessions without any typing time have no WPM and are left out of the fit.
+    uint64_t fitted;
+    double sumX, sumY, sumXY, sumXX;
+
+    void merge(const UserStats &other)
+    {
+        sessions += other.sessions;
+        keys += other.keys;
+        correct += other.correct;
+        seconds += other.seconds;
+        fitted += other.fitted;
+        sumX += other.sumX;
+        sumY += other.sumY;
+        sumXY += other.sumXY;
+        sumXX += other.sumXX;
+    }
+};
+
+struct BigramCell
+{
+    uint64_t count;
+    uint64_t totalMicros;
+};
+
+// Partial results of one worker thread
+class Accumulator
+{
+public:
+    std::vector<UserStats> users;
+    std::vector<BigramCell> bigrams; // CHAR_SLOTS x CHAR_SLOTS, previous then current character
+    uint64_t attempts[CHAR_SLOTS];
+    uint64_t errors[CHAR_SLOTS];
+
+    Accumulator(int userCount) : users(userCount, UserStats()), bigrams(CHAR_SLOTS * CHAR_SLOTS, BigramCell())
+    {
+        memset(attempts, 0, sizeof(attempts));
+        memset(errors, 0, sizeof(errors));
+    }
+
+    void addSession(int user, uint64_t sessionNumber, const KeystrokeSession &session)
+    {
+        UserStats &stats = users[user];
+        uint64_t micros = 0;
+        uint64_t correct = 0;
+        uint64_t keys = 0;
+        bool previousCorrect = false;
+        uint32_t previousExpected = 0;
+
+        for (const auto &block : session.blocks)
+        {
+            for (uint32_t i = 0; i < block.second; i++)
+            {
+                const KeystrokeRecord &key = block.first[i];
+                int slot = charSlot(key.expected);
+                micros += key.getDeltaMicros();
+                keys++;
+                attempts[slot]++;
+                if (key.isCorrect())
+                {
+                    correct++;
+                    // Only clean transitions between two correct keys count towards a bigram
+                    if (previousCorrect)
+                    {
+                        BigramCell &cell = bigrams[charSlot(previousExpected) * CHAR_SLOTS + slot];
+                        cell.count++;
+                        cell.totalMicros += key.getDeltaMicros();
+                    }
+                    previousExpected = key.expected;
+                }
+                else
+                {
+                    errors[slot]++;
+                }
+                previousCorrect = key.isCorrect();
+            }
+        }
+
+        stats.sessions++;
+        stats.keys += keys;
+        stats.correct += correct;
+        stats.seconds += micros / 1000000.0;
+        if (micros > 0)
+        {
+            double wpm = (correct / 5.0) / (micros / 60000000.0);
+            double x = (double)sessionNumber;
+            stats.fitted++;
+            stats.sumX += x;
+            stats.sumY += wpm;
+            stats.sumXY += x * wpm;
+            stats.sumXX += x * x;
+        }
+    }
+
+    void merge(const Accumulator &other)
+    {
+        for (size_t i = 0; i < users.size(); i++)
+            users[i].merge(other.users[i]);
+        for (size_t i = 0; i < bigrams.size(); i++)
+        {
+            bigrams[i].count += other.bigrams[i].count;
+            bigrams[i].totalMicros += other.bigrams[i].totalMicros;
+        }
+        for (int i = 0; i < CHAR_SLOTS; i++)
+        {
+            attempts[i] += other.attempts[i];
+            errors[i] += other.errors[i];
+        }
+    }
+};
+
+// A run of whole sessions inside one log file
+struct Chunk
+{
+    int user;
+    size_t begin;
+    size_t end;
+    uint64_t firstSession; // number of the first session in the chunk within its file
+};
+
+// Splits a log into chunks of roughly CHUNK_BYTES at session boundaries, reading only block headers
+void splitFile(const char *path, int user, std::vector<Chunk> &chunks)
+{
+    KeystrokeLogReader reader;
+    if (!reader.open(path))
+    {
+        fprintf(stderr, "Cannot open keystroke log %s\n", path);
+        return;
+    }
+
+    KeystrokeSession session;
+    Chunk chunk = {user, 0, 0, 0};
+    uint64_t sessionNumber = 0;
+    size_t sessionStart = reader.getOffset();
+    while (reader.nextSession(session))
+    {
+        if (sessionStart - chunk.begin >= CHUNK_BYTES)
+        {
+            chunk.end = sessionStart;
+            chunks.push_back(chunk);
+            chunk.begin = sessionStart;
+            chunk.firstSession = sessionNumber;
+        }
+        sessionNumber++;
+        sessionStart = reader.getOffset();
+    }
+    chunk.end = reader.getSize();
+    if (chunk.end > chunk.begin)
+        chunks.push_back(chunk);
+}
+
+void analyzeChunks(const std::vector<const char *> &files, const std::vector<Chunk> &chunks,
+                   std::atomic<size_t> &nextChunk, Accumulator &result)
+{
+    KeystrokeSession session;
+    for (size_t index = nextChunk++; index < chunks.size(); index = nextChunk++)
+    {
+        const Chunk &chunk = chunks[index];
+        KeystrokeLogReader reader;
+        if (!reader.open(files[chunk.user]))
+            continue;
+        reader.setRange(chunk.begin, chunk.end);
+        uint64_t sessionNumber = chunk.firstSession;
+        while (reader.nextSession(session))
+            result.addSession(chunk.user, sessionNumber++, session);
+    }
+}
+
+void printCharacter(FILE *out, int slot)
+{
+    if (slot == 256)
+        fprintf(out, "other");
+    else if (slot > 32 && slot < 127 && slot != ',' && slot != '"')
+        fprintf(out, "%c", slot);
+    else
+        fprintf(out, "U+%04X", slot);
+}
+
+bool writeReports(const std::string &outDir, const std::vector<const char *> &files, const Accumulator &total)
+{
+    FILE *out = fopen((outDir + "/users.csv").c_str(), "w");
+    if (!out)
+        return false;
+    fprintf(out, "user,sessions,keys,accuracy,mean_wpm,wpm_trend_per_session\n");
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const UserStats &user = total.users[i];
+        double accuracy = user.keys ? 100.0 * user.correct / user.keys : 0;
+        double meanWPM = user.seconds > 0 ? (user.correct / 5.0) / (user.seconds / 60.0) : 0;
+        double n = (double)user.fitted;
+        double denominator = n * user.sumXX - user.sumX * user.sumX;
+        double trend = denominator > 0 ? (n * user.sumXY - user.sumX * user.sumY) / denominator : 0;
+        fprintf(out, "%s,%llu,%llu,%.2f,%.2f,%.4f\n", files[i], (unsigned long long)user.sessions,
+                (unsigned long long)user.keys, accuracy, meanWPM, trend);
+    }
+    fclose(out);
+
+    out = fopen((outDir + "/char_errors.csv").c_str(), "w");
+    if (!out)
+        return false;
+    fprintf(out, "expected,attempts,errors,error_rate\n");
+    for (int slot = 0; slot < CHAR_SLOTS; slot++)
+    {
+        if (total.attempts[slot] == 0)
+            continue;
+        printCharacter(out, slot);
+        fprintf(out, ",%llu,%llu,%.4f\n", (unsigned long long)total.attempts[slot],
+                (unsigned long long)total.errors[slot], (double)total.errors[slot] / total.attempts[slot]);
+    }
+    fclose(out);
+
+    out = fopen((outDir + "/bigram_latency.csv").c_str(), "w");
+    if (!out)
+        return false;
+    fprintf(out, "previous,current,count,mean_ms\n");
+    for (int previous = 0; previous < CHAR_SLOTS; previous++)
+    {
+        for (int current = 0; current < CHAR_SLOTS; current++)
+        {
+            const BigramCell &cell = total.bigrams[previous * CHAR_SLOTS + current];
+            if (cell.count == 0)
+                continue;
+            printCharacter(out, previous);
+            fprintf(out, ",");
+            printCharacter(out, current);
+            fprintf(out, ",%llu,%.2f\n", (unsigned long long)cell.count, cell.totalMicros / 1000.0 / cell.count);
+        }
+    }
+    fclose(out);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int threadCount = (int)std::thread::hardware_concurrency();
+    std::string outDir = ".";
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outDir = argv[++i];
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty())
+    {
+        fprintf(stderr, "Usage: %s [-j threads] [-o output_dir] keystrokes.log...\n", argv[0]);
+        return 1;
+    }
+    if (threadCount < 1)
+        threadCount = 1;
+
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < files.size(); i++)
+        splitFile(files[i], (int)i, chunks);
+
+    std::atomic<size_t> nextChunk(0);
+    std::vector<Accumulator> partials(threadCount, Accumulator((int)files.size()));
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; t++)
+        workers.emplace_back(analyzeChunks, std::cref(files), std::cref(chunks), std::ref(nextChunk), std::ref(partials[t]));
+    for (std::thread &worker : workers)
+        worker.join();
+
+    for (int t = 1; t < threadCount; t++)
+        partials[0].merge(partials[t]);
+
+    if (!writeReports(outDir, files, partials[0]))
+    {
+        fprintf(stderr, "Cannot write reports to %s\n", outDir.c_str());
+        return 1;
+    }
+    printf("Analyzed %zu files in %zu chunks on %d threads\n", files.size(), chunks.size(), threadCount);
+    return 0;
+}
@@ -0,0 +1,432 @@
+// Deterministic benchmark of the typing core: scoring keys, laying out a passage
+// and selecting paragraphs, over passages from one paragraph up to megabytes.
+// All input is synthetic and generated from a seed, so two runs with the same
+// seed do the same work and only the timings differ. Every heap allocation is
+// counted, to show which paths allocate per key, per layout or per selection.
+#include "TypingCore.h"
+#include "TextLayout.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic<uint64_t> allocationCount(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+// GCC sees the replaced operator new inlined next to free() and takes them for a mismatch
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+double now()
+{
+    static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// Time and heap allocations between start() and stop()
+class Measurement
+{
+private:
+    double startTime;
+    uint64_t startCount;
+    uint64_t startBytes;
+
+public:
+    double seconds;
+    uint64_t allocations;
+    uint64_t bytes;
+
+    Measurement() : startTime(0), startCount(0), startBytes(0), seconds(0), allocations(0), bytes(0) {}
+
+    void start()
+    {
+        startCount = allocationCount.load(std::memory_order_relaxed);
+        startBytes = allocatedBytes.load(std::memory_order_relaxed);
+        startTime = now();
+    }
+
+    // Measurements accumulate over several start()/stop() pairs
+    void stop()
+    {
+        seconds += now() - startTime;
+        allocations += allocationCount.load(std::memory_order_relaxed) - startCount;
+        bytes += allocatedBytes.load(std::memory_order_relaxed) - startBytes;
+    }
+};
+
+// Word list the synthetic passages are drawn from; a few words are accented so
+// the UTF-8 decoding is exercised as well
+const char *const WORDS[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "typing", "speed", "accuracy", "keyboard",
+    "practice", "makes", "perfect", "computer", "program", "algorithm", "structure", "network", "memory", "a",
+    "of", "and", "to", "in", "is", "that", "for", "with", "as", "on", "polymorphism", "encapsulation", "inheritance",
+    "café", "naïve", "über", "façade", "résumé", "déjà", "vu", "Straße", "niño", "coöperate"};
+const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// Words separated by single spaces, with a sentence break every dozen words or so
+std::string makePassage(std::mt19937 &random, size_t bytes)
+{
+    std::string passage;
+    passage.reserve(bytes + 32);
+    int sentence = 0;
+    while (passage.size() < bytes)
+    {
+        if (!passage.empty())
+            passage.push_back(' ');
+        std::string word = WORDS[random() % WORD_COUNT];
+        if (sentence == 0)
+            word[0] = (char)toupper((unsigned char)word[0]);
+        passage += word;
+        if (++sentence >= 8 + (int)(random() % 8))
+        {
+            passage.push_back('.');
+            sentence = 0;
+        }
+    }
+    return passage;
+}
+
+// Input files for the benchmark in the system temp directory, removed again on
+// every way out of main()
+class ScratchFiles
+{
+private:
+    std::string prefix;
+    std::vector<std::string> paths;
+
+public:
+    ScratchFiles()
+    {
+        std::error_code error;
+        std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+        if (error)
+            directory = ".";
+        // Unique per run, so parallel runs do not overwrite each other's input
+        std::string name = "tst_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+        prefix = (directory / name).string();
+    }
+
+    ~ScratchFiles()
+    {
+        for (const std::string &path : paths)
+            remove(path.c_str());
+    }
+
+    ScratchFiles(const ScratchFiles &) = delete;
+    ScratchFiles &operator=(const ScratchFiles &) = delete;
+
+    std::string add(const char *suffix)
+    {
+        paths.push_back(prefix + suffix);
+        return paths.back();
+    }
+};
+
+bool writeFile(const char *path, const std::string &contents)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    fwrite(contents.data(), 1, contents.size(), file);
+    return fclose(file) == 0;
+}
+
+// The keys a typist with the given error rate presses to get through a passage:
+// every mistake is one wrong key before the right one
+void makeKeys(std::mt19937 &random, const int *codepoints, int length, double errorRate, std::vector<int> &keys)
+{
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    keys.clear();
+    for (int i = 0; i < length; i++)
+    {
+        int expected = codepoints[i];
+        if (chance(random) < errorRate)
+            keys.push_back(expected == 'x' ? 'z' : 'x');
+        keys.push_back(expected);
+    }
+}
+
+struct ScoringResult
+{
+    size_t bytes;
+    int codepoints;
+    uint64_t keys;
+    Measurement measurement;
+};
+
+struct LayoutResult
+{
+    size_t bytes;
+    int words;
+    int lines;
+    int layouts;
+    Measurement measurement;
+};
+
+struct SelectionResult
+{
+    const char *name;
+    int passages;
+    int selections;
+    Measurement measurement;
+};
+
+// Marathon sessions over the passage with a weakness model attached, as in the
+// app, repeated until at least minKeys keys were scored. Only checkInput() is timed.
+ScoringResult benchScoring(std::mt19937 &random, const char *path, size_t bytes, uint64_t minKeys,
+                           WeaknessModel &weakness)
+{
+    ScoringResult result = {};
+    result.bytes = bytes;
+
+    ManualClock clock;
+    MarathonMode mode;
+    mode.setClock(&clock);
+    mode.setWeaknessModel(&weakness);
+    if (!mode.load(path))
+        return result;
+    result.codepoints = mode.getLength();
+
+    std::vector<int> keys;
+    makeKeys(random, mode.getCodepoints(), mode.getLength(), 0.03, keys);
+    while (result.keys < minKeys)
+    {
+        mode.selectParagraph(0);
+        mode.startGame();
+        result.measurement.start();
+        for (int key : keys)
+        {
+            clock.advance(0.15);
+            mode.checkInput(key, clock.now());
+        }
+        result.measurement.stop();
+        result.keys += keys.size();
+    }
+    return result;
+}
+
+// The layout the app rebuilds when the paragraph or window size changes, with a
+// glyph table shaped like raylib's default font at the app's default text size
+LayoutResult benchLayout(const char *path, size_t bytes, double minSeconds)
+{
+    LayoutResult result = {};
+    result.bytes = bytes;
+
+    MarathonMode mode;
+    if (!mode.load(path))
+        return result;
+
+    GlyphAdvances glyphs;
+    glyphs.reset(10);
+    for (int c = 32; c < 256; c++)
+        glyphs.add(c, c == ' ' || c == 'i' || c == 'l' || c == '.' ? 3.0f : (c == 'm' || c == 'w' ? 8.0f : 6.0f));
+    glyphs.finish();
+
+    std::vector<WordLayout> words;
+    std::vector<LineLayout> lines;
+    // The first layout grows the vectors; the app keeps them, so only later layouts are measured
+    layoutWords(mode.getCodepoints(), mode.getLength(), glyphs, 20, 2, 20, 1000 - 20, words, lines);
+    while (result.layouts < 3 || result.measurement.seconds < minSeconds)
+    {
+        result.measurement.start();
+        layoutWords(mode.getCodepoints(), mode.getLength(), glyphs, 20, 2, 20, 1000 - 20, words, lines);
+        result.measurement.stop();
+        result.layouts++;
+    }
+    result.words = (int)words.size();
+    result.lines = (int)lines.size();
+    return result;
+}
+
+// Repeated paragraph selection, as done by Next and by switching modes
+SelectionResult benchSelection(const char *name, TextMode &mode, int selections)
+{
+    SelectionResult result = {name, mode.getParagraphCount(), selections, Measurement()};
+    result.measurement.start();
+    for (int i = 0; i < selections; i++)
+        mode.selectRandomParagraph();
+    result.measurement.stop();
+    return result;
+}
+
+void printMeasurement(FILE *file, const Measurement &measurement, double operations, const char *rateName,
+                      const char *perName)
+{
+    fprintf(file, "\"seconds\": %.6f, \"%s\": %.1f, \"allocations_per_%s\": %.4f, \"bytes_per_%s\": %.1f",
+            measurement.seconds, rateName, measurement.seconds > 0 ? operations / measurement.seconds : 0.0, perName,
+            measurement.allocations / operations, perName, measurement.bytes / operations);
+}
+
+bool writeResults(const char *path, unsigned int seed, bool quick, const std::vector<ScoringResult> &scoring,
+                  const std::vector<LayoutResult> &layout, const std::vector<SelectionResult> &selection)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "{\n  \"seed\": %u,\n  \"quick\": %s,\n  \"scoring\": [\n", seed, quick ? "true" : "false");
+    for (size_t i = 0; i < scoring.size(); i++)
+    {
+        const ScoringResult &result = scoring[i];
+        fprintf(file, "    {\"bytes\": %zu, \"codepoints\": %d, \"keys\": %llu, ", result.bytes, result.codepoints,
+                (unsigned long long)result.keys);
+        printMeasurement(file, result.measurement, (double)result.keys, "keys_per_second", "key");
+        fprintf(file, "}%s\n", i + 1 < scoring.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n  \"layout\": [\n");
+    for (size_t i = 0; i < layout.size(); i++)
+    {
+        const LayoutResult &result = layout[i];
+        fprintf(file, "    {\"bytes\": %zu, \"words\": %d, \"lines\": %d, \"layouts\": %d, \"ms_per_layout\": %.4f, ",
+                result.bytes, result.words, result.lines, result.layouts,
+                result.measurement.seconds * 1000 / result.layouts);
+        printMeasurement(file, result.measurement, result.layouts, "layouts_per_second", "layout");
+        fprintf(file, "}%s\n", i + 1 < layout.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n  \"selection\": [\n");
+    for (size_t i = 0; i < selection.size(); i++)
+    {
+        const SelectionResult &result = selection[i];
+        fprintf(file, "    {\"name\": \"%s\", \"passages\": %d, \"selections\": %d, ", result.name, result.passages,
+                result.selections);
+        printMeasurement(file, result.measurement, result.selections, "selections_per_second", "selection");
+        fprintf(file, "}%s\n", i + 1 < selection.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int seed = 1;
+    bool quick = false;
+    const char *outputPath = "bench_results.json";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s seed] [-o results.json] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // randomIndex() in the core draws from rand()
+    srand(seed);
+    std::mt19937 random(seed);
+
+    // Declared before the corpus, so the corpus is unmapped before its file is removed
+    ScratchFiles scratch;
+    std::string passagePath = scratch.add("_passage.txt");
+    std::string corpusSourcePath = scratch.add("_corpus.txt");
+    std::string corpusPath = scratch.add("_corpus.tstc");
+    std::vector<size_t> sizes = {250, 4 << 10, 64 << 10, 1 << 20, 4 << 20};
+    if (quick)
+        sizes.pop_back();
+    uint64_t minKeys = quick ? 200000 : 2000000;
+    double minLayoutSeconds = quick ? 0.05 : 0.5;
+
+    WeaknessModel weakness;
+    std::vector<ScoringResult> scoring;
+    std::vector<LayoutResult> layout;
+    printf("%-10s %12s %14s %12s %14s %12s\n", "passage", "keys/s", "allocs/key", "words", "ms/layout", "allocs/layout");
+    for (size_t bytes : sizes)
+    {
+        if (!writeFile(passagePath.c_str(), makePassage(random, bytes)))
+        {
+            fprintf(stderr, "Cannot write %s\n", passagePath.c_str());
+            return 1;
+        }
+        scoring.push_back(benchScoring(random, passagePath.c_str(), bytes, minKeys, weakness));
+        layout.push_back(benchLayout(passagePath.c_str(), bytes, minLayoutSeconds));
+
+        const ScoringResult &score = scoring.back();
+        const LayoutResult &lay = layout.back();
+        printf("%-10zu %12.0f %14.4f %12d %14.4f %12.2f\n", bytes, score.keys / score.measurement.seconds,
+               (double)score.measurement.allocations / score.keys, lay.words,
+               lay.measurement.seconds * 1000 / lay.layouts, (double)lay.measurement.allocations / lay.layouts);
+    }
+
+    // Selection from the built-in paragraphs, then drills over a generated corpus
+    // driven by the weakness data gathered while scoring
+    std::vector<SelectionResult> selection;
+    int selections = quick ? 20000 : 200000;
+    EasyMode builtIn;
+    selection.push_back(benchSelection("builtin", builtIn, selections));
+
+    int corpusPassages = quick ? 2000 : 20000;
+    std::string corpusText;
+    for (int i = 0; i < corpusPassages; i++)
+        corpusText += "easy\t" + makePassage(random, 200 + random() % 300) + "\n";
+    if (!writeFile(corpusSourcePath.c_str(), corpusText) ||
+        !ParagraphCorpus::build(corpusSourcePath.c_str(), corpusPath.c_str()))
+    {
+        fprintf(stderr, "Cannot build the corpus %s\n", corpusPath.c_str());
+        return 1;
+    }
+    {
+        ParagraphCorpus corpus;
+        corpus.open(corpusPath.c_str());
+        EasyMode drill;
+        drill.setCorpus(&corpus);
+        drill.setWeaknessModel(&weakness);
+        selection.push_back(benchSelection("corpus", drill, selections));
+
+        double indexStart = now();
+        drill.buildDrillIndex();
+        while (!drill.isDrillIndexReady())
+            std::this_thread::yield();
+        printf("\ndrill index over %d passages built in %.1f ms\n", corpusPassages, (now() - indexStart) * 1000);
+        selection.push_back(benchSelection("drill", drill, selections / 10));
+    }
+
+    printf("%-10s %12s %16s %16s\n", "selection", "passages", "selections/s", "allocs/selection");
+    for (const SelectionResult &result : selection)
+    {
+        printf("%-10s %12d %16.0f %16.2f\n", result.name, result.passages,
+               result.selections / result.measurement.seconds,
+               (double)result.measurement.allocations / result.selections);
+    }
+
+    if (!writeResults(outputPath, seed, quick, scoring, layout, selection))
+    {
+        fprintf(stderr, "Cannot write %s\n", outputPath);
+        return 1;
+    }
+    printf("\nresults written to %s\n", outputPath);
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Correctness checks for the headless core, kept apart from the benchmark so a
+// failure shows up as a failed check rather than as a benchmark result. Prints
+// each check and exits non-zero if any failed.
+#include "ErrorMap.h"
+#include "KeystrokeLog.h"
+#include "TypingCore.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A file name in the system temp directory, unique per run; the caller removes it
+std::string scratchPath(const char *suffix)
+{
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+    if (error)
+        directory = ".";
+    std::string name = "tst_check_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    return (directory / (name + suffix)).string();
+}
+
+// The renderer asks for mistakes up to one past the end of the last word, so the
+// error bitmap must stop at the passage length, also when it fills whole 64-bit words
+bool checkErrorBitmap()
+{
+    const int lengths[] = {1, 63, 64, 65, 128};
+    ErrorBitmap errors;
+    std::vector<ErrorRun> runs;
+    for (int length : lengths)
+    {
+        errors.reset(length);
+        errors.set(0);
+        errors.set(length - 1);
+        errors.set(length);
+        int expected = length > 1 ? 2 : 1;
+        errors.runs(length - 1, length + 1, runs);
+        if (errors.count(0, length + 1) != expected || errors.count(length - 1, length + 64) != 1 ||
+            errors.test(length) || runs.size() != 1 || runs[0].end != length || !runs[0].error)
+        {
+            fprintf(stderr, "  a %d character passage\n", length);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sessions much longer than the log buffer, and an empty one, come back with
+// every key in order and the outcome they were ended with
+bool checkKeystrokeLogRoundTrip()
+{
+    const KeystrokeOutcome outcomes[] = {KEYLOG_COMPLETED, KEYLOG_TIMED_OUT, KEYLOG_ABANDONED};
+    const int sessionCount = 5;
+    std::string path = scratchPath(".log");
+    {
+        KeystrokeLog log(path.c_str(), 8);
+        for (int s = 0; s < sessionCount; s++)
+        {
+            log.beginSession(s % 4, s, 1.0);
+            for (int i = 0; i < s * 251; i++)
+                log.record(s * 10000 + i, 'a', i % 7 != 0, 1.0 + i * 0.01);
+            log.endSession(outcomes[s % 3]);
+        }
+    }
+
+    bool passed;
+    {
+        KeystrokeLogReader reader;
+        passed = reader.open(path.c_str());
+        KeystrokeSession session;
+        int sessions = 0;
+        while (passed && reader.nextSession(session))
+        {
+            int keys = 0;
+            for (const auto &block : session.blocks)
+            {
+                for (uint32_t i = 0; i < block.second; i++, keys++)
+                {
+                    const KeystrokeRecord &key = block.first[i];
+                    if (key.codepoint != (uint32_t)(sessions * 10000 + keys) || key.isCorrect() != (keys % 7 != 0))
+                        passed = false;
+                }
+            }
+            if (keys != sessions * 251 || session.mode != sessions % 4 || session.paragraph != sessions ||
+                session.outcome != outcomes[sessions % 3])
+            {
+                fprintf(stderr, "  session %d\n", sessions);
+                passed = false;
+            }
+            sessions++;
+        }
+        if (sessions != sessionCount)
+            passed = false;
+    }
+    remove(path.c_str());
+    return passed;
+}
+
+// 100 keys at 0.2 s each and then a timeout is 20 words in 30 s, both live and
+// when the session is replayed from the log
+bool checkTimedOutReplay()
+{
+    std::string path = scratchPath(".log");
+    ManualClock clock;
+    float liveWPM;
+    {
+        KeystrokeLog log(path.c_str());
+        EasyMode mode;
+        mode.setClock(&clock);
+        mode.setKeystrokeLog(&log);
+        mode.selectParagraph(0);
+        clock.set(0);
+        mode.startGame();
+        for (int i = 0; i < 100; i++)
+        {
+            clock.advance(0.2);
+            mode.checkInput(mode.getCodepoints()[i], clock.now());
+        }
+        clock.set(mode.getTimeLimit());
+        mode.updateTimer();
+        liveWPM = mode.getWPM();
+    }
+
+    bool passed;
+    {
+        KeystrokeLogReader reader;
+        KeystrokeSession session;
+        passed = reader.open(path.c_str()) && reader.nextSession(session) && session.outcome == KEYLOG_TIMED_OUT;
+        if (passed)
+        {
+            EasyMode mode;
+            replaySession(mode, clock, session);
+            passed = std::fabs(liveWPM - 40) < 0.01f && std::fabs(mode.getWPM() - liveWPM) < 0.01f;
+            if (!passed)
+                fprintf(stderr, "  %.2f WPM live, %.2f WPM replayed\n", liveWPM, mode.getWPM());
+        }
+    }
+    remove(path.c_str());
+    return passed;
+}
+
+struct Check
+{
+    const char *name;
+    bool (*run)();
+};
+
+int main()
+{
+    const Check checks[] = {
+        {"error bitmap stops at the passage length", checkErrorBitmap},
+        {"keystroke log round trip through a small buffer", checkKeystrokeLogRoundTrip},
+        {"timed-out session replays to the time limit", checkTimedOutReplay},
+    };
+    int failed = 0;
+    for (const Check &check : checks)
+    {
+        bool passed = check.run();
+        printf("%-50s %s\n", check.name, passed ? "ok" : "FAILED");
+        if (!passed)
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
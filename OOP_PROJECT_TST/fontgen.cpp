@@ -0,0 +1,135 @@
+// Build-time generator for the embedded font. Renders a TTF/OTF font into a
+// signed distance field atlas with raylib and writes it, together with each
+// glyph's rectangle, offsets and advance, as a C++ header (FontAtlas.h) that
+// SdfFont.h compiles into the app.
+#include "raylib.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// ASCII, Latin-1 and Latin Extended-A, enough for most European corpora
+const int DEFAULT_RANGES[][2] = {{0x20, 0x7E}, {0xA0, 0xFF}, {0x100, 0x17F}};
+
+bool parseRange(const char *text, std::vector<int> &codepoints)
+{
+    char *end = nullptr;
+    long first = strtol(text, &end, 16);
+    if (*end != '-')
+        return false;
+    long last = strtol(end + 1, &end, 16);
+    if (*end != '\0' || first < 0 || last < first || last > 0x10FFFF)
+        return false;
+    for (long c = first; c <= last; c++)
+        codepoints.push_back((int)c);
+    return true;
+}
+
+bool writeHeader(const char *path, const char *fontPath, const Image &atlas, const GlyphInfo *glyphs,
+                 const Rectangle *recs, int glyphCount, int baseSize)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out)
+        return false;
+
+    fprintf(out, "#pragma once\n");
+    fprintf(out, "// Generated by fontgen from %s; do not edit\n\n", fontPath);
+    fprintf(out, "struct FontAtlasGlyph\n{\n    int codepoint;\n    short x, y, width, height;\n"
+                 "    short offsetX, offsetY, advanceX;\n};\n\n");
+    fprintf(out, "const int FONT_ATLAS_BASE_SIZE = %d;\n", baseSize);
+    fprintf(out, "const int FONT_ATLAS_WIDTH = %d;\n", atlas.width);
+    fprintf(out, "const int FONT_ATLAS_HEIGHT = %d;\n", atlas.height);
+    fprintf(out, "const int FONT_ATLAS_GLYPH_COUNT = %d;\n\n", glyphCount);
+
+    fprintf(out, "static const FontAtlasGlyph FONT_ATLAS_GLYPHS[] = {\n");
+    for (int i = 0; i < glyphCount; i++)
+    {
+        fprintf(out, "    {0x%X, %d, %d, %d, %d, %d, %d, %d},\n", glyphs[i].value, (int)recs[i].x, (int)recs[i].y,
+                (int)recs[i].width, (int)recs[i].height, glyphs[i].offsetX, glyphs[i].offsetY, glyphs[i].advanceX);
+    }
+    fprintf(out, "};\n\n");
+
+    // One distance byte per pixel, taken from the alpha channel of the atlas
+    const unsigned char *pixels = (const unsigned char *)atlas.data;
+    int pixelCount = atlas.width * atlas.height;
+    fprintf(out, "static const unsigned char FONT_ATLAS_PIXELS[] = {\n");
+    for (int i = 0; i < pixelCount; i++)
+    {
+        fprintf(out, "%s%d,", i % 24 == 0 ? (i ? "\n" : "") : "", pixels[2 * i + 1]);
+    }
+    fprintf(out, "\n};\n");
+
+    bool ok = !ferror(out);
+    return fclose(out) == 0 && ok;
+}
+
+int main(int argc, char **argv)
+{
+    const char *fontPath = nullptr;
+    const char *outPath = "FontAtlas.h";
+    int baseSize = 32;
+    std::vector<int> codepoints;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            baseSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            if (!parseRange(argv[++i], codepoints))
+            {
+                fprintf(stderr, "Bad range %s, expected hex FIRST-LAST such as 370-3FF\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+            fontPath = argv[i];
+    }
+    if (!fontPath || baseSize < 8)
+    {
+        fprintf(stderr, "Usage: %s [-s size] [-r FIRST-LAST]... [-o FontAtlas.h] font.ttf\n", argv[0]);
+        return 1;
+    }
+    for (const auto &range : DEFAULT_RANGES)
+    {
+        for (int c = range[0]; c <= range[1]; c++)
+            codepoints.push_back(c);
+    }
+    std::sort(codepoints.begin(), codepoints.end());
+    codepoints.erase(std::unique(codepoints.begin(), codepoints.end()), codepoints.end());
+
+    SetTraceLogLevel(LOG_WARNING);
+    int fileSize = 0;
+    unsigned char *fileData = LoadFileData(fontPath, &fileSize);
+    if (!fileData)
+    {
+        fprintf(stderr, "Cannot read %s\n", fontPath);
+        return 1;
+    }
+
+    int glyphCount = (int)codepoints.size();
+    GlyphInfo *glyphs = LoadFontData(fileData, fileSize, baseSize, codepoints.data(), glyphCount, FONT_SDF);
+    UnloadFileData(fileData);
+    if (!glyphs)
+    {
+        fprintf(stderr, "Cannot load glyphs from %s\n", fontPath);
+        return 1;
+    }
+
+    Rectangle *recs = nullptr;
+    Image atlas = GenImageFontAtlas(glyphs, &recs, glyphCount, baseSize, 0, 1);
+    ImageFormat(&atlas, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA);
+
+    bool ok = writeHeader(outPath, fontPath, atlas, glyphs, recs, glyphCount, baseSize);
+    if (ok)
+        printf("%d glyphs, %dx%d atlas written to %s\n", glyphCount, atlas.width, atlas.height, outPath);
+    else
+        fprintf(stderr, "Cannot write %s\n", outPath);
+
+    UnloadImage(atlas);
+    MemFree(recs);
+    UnloadFontData(glyphs, glyphCount);
+    return ok ? 0 : 1;
+}
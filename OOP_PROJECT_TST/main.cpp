@@ -1,260 +1,328 @@
 #include "raylib.h"
+#include "TypingCore.h"
+#include "Profiler.h"
+#include "SdfFont.h"
+#include "TextLayout.h"
+#ifndef _WIN32
+#include "RaceClient.h"
+#define TST_RACES
+#endif
 #include <string>
+#include <vector>
 #include <ctime>
 #include <cstdlib>
 #include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
 
-// Base class / parent class
-class TextMode
+// Clock backed by raylib's timer, shared by the GUI and its typing sessions
+class RaylibClock : public Clock
 {
-protected:
-    const char *text;
-    int textLength;
-    int currentPosition;
-    int mistakes;
-    float startTime;
-    bool isTyping;
-    bool isTimeUp;
-    bool isStarted;
-    const char *paragraphs[10];
-    int currentParagraph;
-    float finalWPM;
-    float finalCPM;
-    float finalAccuracy;
-    bool isCompleted;
-    float completionTime;
-
 public:
-    TextMode() : currentPosition(0), mistakes(0), startTime(0), isTyping(false),
-                 isTimeUp(false), isStarted(false), currentParagraph(0),
-                 finalWPM(0), finalCPM(0), finalAccuracy(0), isCompleted(false),
-                 completionTime(0)
-    {
-    }
-    virtual ~TextMode() {}
-
-    virtual const char *getText() { return text; }
-    virtual int getLength() { return textLength; }
-    virtual int getCurrentPosition() { return currentPosition; }
-    virtual int getMistakes() { return mistakes; }
-    virtual float getStartTime() { return startTime; }
-    virtual bool getIsTyping() { return isTyping; }
-    virtual bool getIsTimeUp() { return isTimeUp; }
-    virtual bool getIsStarted() { return isStarted; }
-    virtual bool getIsCompleted() { return isCompleted; }
-    virtual float getCompletionTime() { return completionTime; }
-
-    virtual void startTyping()
+    double now() override { return GetTime(); }
+};
+
+// Word colours, in the order the cursor moves through them
+enum WordState
+{
+    WORD_UPCOMING,
+    WORD_CURRENT,
+    WORD_TYPED
+};
+
+class TypingTracker
+{
+private:
+    RaylibClock clock;
+    KeystrokeLog keyLog;
+    SessionHistory history;
+    WeaknessModel weakness;
+    FrameProfiler profiler;
+    const ParagraphCorpus *corpus;
+#ifdef TST_RACES
+    RaceClient *race; // set when connected to a race server
+#endif
+    // The sessions are built once and reused, so switching never allocates
+    EasyMode easyMode;
+    MediumMode mediumMode;
+    HardMode hardMode;
+    MarathonMode marathonMode;
+    TextMode *modes[4];
+    TextMode *currentMode;
+    int selectedMode;
+    int screenWidth;
+    int screenHeight;
+    float scaleFactor;
+    int fontSize;
+    int lineHeight;
+    int margin;
+    int textAreaWidth;
+    int textAreaHeight;
+    int textY;
+    int maxVisibleLines;
+    int currentScroll;
+    int visibleLines;
+
+    // Word layout cache, rebuilt only when the paragraph or screen size changes.
+    // Only the visibleLines lines starting at currentScroll are ever drawn.
+    std::vector<WordLayout> words;
+    std::vector<LineLayout> lines;
+    SdfFont textFont;   // the embedded SDF font, when the build has one
+    Font paragraphFont; // textFont, or raylib's default font without one
+    GlyphAdvances glyphs;
+    const char *layoutSource;
+    bool layoutDirty;
+
+    // Redraw tracking: the scene is only repainted after input, a resize, or when
+    // the timer display (0.1 s resolution) changes
+    bool needsRedraw;
+    long lastTimerTick;
+
+    // The laid-out paragraph rasterized off-screen; keystrokes only repaint the
+    // words whose colour changed, and each frame draws it as a single quad
+    RenderTexture2D paragraphTexture;
+    bool textureDirty;
+    int paintedPosition;
+    int paintedMistakes;
+    int spaceWidth;
+    std::vector<ErrorRun> errorRuns;
+
+    static int wordState(const WordLayout &word, int pos)
     {
-        if (!isTyping && isStarted)
-        {
-            isTyping = true;
-            startTime = GetTime();
-            isTimeUp = false;
-            isCompleted = false;
-            completionTime = 0;
-        }
+        if (word.end <= pos)
+            return WORD_TYPED;
+        if (word.start <= pos && pos < word.end)
+            return WORD_CURRENT;
+        return WORD_UPCOMING;
     }
 
-    virtual void checkInput(int key)
+    static Color wordColor(int state)
     {
-        if (!isTyping || isTimeUp || !isStarted || isCompleted)
-            return;
-
-        if (key == text[currentPosition])
-        {
-            currentPosition++;
-            if (currentPosition >= textLength)
-            {
-                isCompleted = true;
-                completionTime = GetTime() - startTime;
-                calculateFinalStats();
-            }
-        }
-        else
+        switch (state)
         {
-            mistakes++;
+        case WORD_TYPED:
+            return GREEN; // Already typed
+        case WORD_CURRENT:
+            return BLUE; // Current word
+        default:
+            return GRAY; // Upcoming text
         }
     }
 
-    virtual void calculateFinalStats()
+    // A word is repainted when its state or the number of mistyped characters
+    // in it, including the space after it, changes
+    int paintKey(const WordLayout &word, int pos)
     {
-        float timeInMinutes = completionTime / 60.0f;
-        finalWPM = (currentPosition / 5.0f) / timeInMinutes;
-        finalCPM = currentPosition / timeInMinutes;
-        finalAccuracy = ((float)currentPosition / (currentPosition + mistakes)) * 100;
+        return wordState(word, pos) | currentMode->getErrors().count(word.start, word.end + 1) << 2;
     }
 
-    virtual bool isComplete()
+    bool isLineVisible(int line)
     {
-        return isCompleted || isTimeUp;
+        return line >= currentScroll && line < currentScroll + visibleLines;
     }
 
-    virtual float getWPM()
+    // Scrolls so the line holding the cursor stays in view, with one line of
+    // context above it when the window is tall enough
+    void updateScroll()
     {
-        if (!isTyping || !isStarted)
-            return 0;
-        if (isCompleted || isTimeUp)
-            return finalWPM;
-        float timeInMinutes = (GetTime() - startTime) / 60.0f;
-        return (currentPosition / 5.0f) / timeInMinutes;
-    }
+        if (lines.empty())
+            return;
 
-    virtual float getCPM()
-    {
-        if (!isTyping || !isStarted)
-            return 0;
-        if (isCompleted || isTimeUp)
-            return finalCPM;
-        float timeInMinutes = (GetTime() - startTime) / 60.0f;
-        return currentPosition / timeInMinutes;
-    }
+        int pos = currentMode->getCurrentPosition();
+        auto after = std::upper_bound(lines.begin(), lines.end(), pos,
+                                      [](int p, const LineLayout &line) { return p < line.start; });
+        int cursorLine = std::max(0, (int)(after - lines.begin()) - 1);
+        int context = visibleLines > 2 ? 1 : 0;
 
-    virtual float getAccuracy()
-    {
-        if (currentPosition + mistakes == 0)
-            return 100;
-        if (isCompleted || isTimeUp)
-            return finalAccuracy;
-        return ((float)currentPosition / (currentPosition + mistakes)) * 100;
+        int scroll = currentScroll;
+        if (cursorLine >= scroll + visibleLines - context || cursorLine < scroll + context)
+            scroll = cursorLine - context;
+        scroll = std::max(0, std::min(scroll, (int)lines.size() - visibleLines));
+
+        if (scroll != currentScroll)
+        {
+            currentScroll = scroll;
+            textureDirty = true;
+        }
     }
 
-    virtual void selectRandomParagraph()
+    // DrawText's size and spacing for the default font at the current scale; the
+    // embedded font's advances already include the gap between glyphs
+    float textSize() { return (float)std::max((int)(fontSize * scaleFactor), 10); }
+    float textSpacing() { return textFont.isLoaded() ? 0.0f : (float)((int)textSize() / 10); }
+
+    // Draws a word as runs of its own colour and RED for mistyped characters,
+    // one draw call per run; a clean word is a single run
+    void paintWord(WordLayout &word, int key, bool clearBehind)
     {
-        currentParagraph = rand() % 10;
-        text = paragraphs[currentParagraph];
-        textLength = strlen(text);
-        currentPosition = 0;
-        mistakes = 0;
-        isTyping = false;
-        isTimeUp = false;
-        isStarted = false;
-        isCompleted = false;
-        finalWPM = 0;
-        finalCPM = 0;
-        finalAccuracy = 0;
-        completionTime = 0;
+        int scaledFontSize = (int)(fontSize * scaleFactor);
+        int scaledLineHeight = (int)(lineHeight * scaleFactor);
+        int y = (word.line - currentScroll) * scaledLineHeight;
+        if (clearBehind)
+            DrawRectangle(word.x, y, word.width + spaceWidth, scaledLineHeight, RAYWHITE);
+
+        const ErrorBitmap &errors = currentMode->getErrors();
+        Color color = wordColor(key & 3);
+        errors.runs(word.start, word.end, errorRuns);
+        const int *codepoints = currentMode->getCodepoints();
+        float size = textSize();
+        float spacing = textSpacing();
+        float x = (float)word.x;
+        for (const ErrorRun &run : errorRuns)
+        {
+            int count = run.end - run.start;
+            DrawTextCodepoints(paragraphFont, codepoints + run.start, count, Vector2{x, (float)y}, size, spacing,
+                               run.error ? RED : color);
+            x += glyphs.measure(codepoints + run.start, count, size, spacing) + spacing;
+        }
+
+        // A mistyped space is underlined in the gap after the word
+        if (errors.test(word.end))
+        {
+            int thickness = std::max(2, (int)(2 * scaleFactor));
+            DrawRectangle(word.x + word.width, y + scaledFontSize, spaceWidth, thickness, RED);
+        }
+        word.painted = key;
     }
 
-    virtual void updateTimer()
+    void updateParagraphTexture()
     {
-        if (isTyping && !isTimeUp && isStarted && !isCompleted)
+        int pos = currentMode->getCurrentPosition();
+
+        if (textureDirty)
         {
-            float elapsedTime = GetTime() - startTime;
-            if (elapsedTime >= 30.0f)
+            // Only the visible window of lines is rasterized
+            int scaledLineHeight = (int)(lineHeight * scaleFactor);
+            int windowLines = std::min((int)lines.size() - currentScroll, visibleLines);
+            int height = std::min(windowLines * scaledLineHeight, screenHeight - textY);
+            if (height <= 0)
+                return;
+
+            if (paragraphTexture.id == 0 || paragraphTexture.texture.width != screenWidth ||
+                paragraphTexture.texture.height != height)
+            {
+                if (paragraphTexture.id != 0)
+                    UnloadRenderTexture(paragraphTexture);
+                paragraphTexture = LoadRenderTexture(screenWidth, height);
+            }
+
+            BeginTextureMode(paragraphTexture);
+            textFont.begin();
+            ClearBackground(RAYWHITE);
+            for (int i = lines[currentScroll].firstWord; i < (int)words.size() && isLineVisible(words[i].line); i++)
             {
-                isTimeUp = true;
-                completionTime = 30.0f;
-                calculateFinalStats();
+                paintWord(words[i], paintKey(words[i], pos), false);
             }
+            textFont.end();
+            EndTextureMode();
+
+            textureDirty = false;
+            paintedPosition = pos;
+            paintedMistakes = currentMode->getMistakes();
+            return;
         }
-    }
 
-    virtual float getRemainingTime()
-    {
-        if (!isTyping || !isStarted || isCompleted)
-            return 30.0f;
-        if (isTimeUp)
-            return 0;
-        float elapsedTime = GetTime() - startTime;
-        return (30.0f - elapsedTime) > 0 ? (30.0f - elapsedTime) : 0;
-    }
+        int mistakes = currentMode->getMistakes();
+        if (pos == paintedPosition && mistakes == paintedMistakes)
+            return;
 
-    virtual void startGame()
-    {
-        isStarted = true;
-        startTyping();
-    }
-};
+        // Only words between the old and the new cursor position can change colour.
+        // Mistakes are made at the cursor, which may be the space after a word.
+        int low = std::min(pos, paintedPosition);
+        int high = std::max(pos, paintedPosition);
+        auto first = std::upper_bound(words.begin(), words.end(), low - 1,
+                                      [](int p, const WordLayout &word) { return p < word.end; });
 
-class EasyMode : public TextMode
-{
-public:
-    EasyMode()
-    {
-        paragraphs[0] = "The quick brown fox jumps over the lazy dog. This is a simple test for typing speed. Learning to type quickly and accurately is an important skill. The sun rises in the east and sets in the west. Practice makes perfect in everything we do.";
-        paragraphs[1] = "A good typing speed helps you work more efficiently. The keyboard is your tool for digital communication. Typing is a skill that everyone should learn. Computers are powerful tools in our daily lives. Speed and accuracy are both important when typing.";
-        paragraphs[2] = "The internet has changed how we work and communicate. Good typing skills are essential for success. Computers are everywhere in our modern world. Being able to type well makes everything easier. Practice every day to improve your skills.";
-        paragraphs[3] = "Typing is like playing a musical instrument. Start slow and focus on accuracy first. Use all your fingers when typing. Keep your eyes on the screen, not the keyboard. This will help you type faster with fewer mistakes.";
-        paragraphs[4] = "The home row keys are the foundation of good typing. Your fingers should rest on ASDF and JKL. From there, you can reach all other keys. Practice typing without looking at the keyboard. This is called touch typing.";
-        paragraphs[5] = "Regular practice is the key to improving your typing. Set aside time each day to practice. Use online typing tests to measure progress. Try to beat your previous scores. Remember that accuracy is more important than speed.";
-        paragraphs[6] = "Good posture is important when typing for long periods. Sit up straight with your feet flat on the floor. Keep your wrists straight and fingers curved. Take breaks often to rest your hands. Comfort is important for good typing.";
-        paragraphs[7] = "The QWERTY keyboard layout was designed long ago. It was made to prevent typewriter keys from jamming. Today, we still use this layout for computers. Some people use different layouts like Dvorak. But QWERTY is the most common.";
-        paragraphs[8] = "Typing games can make practice fun and engaging. They help you learn while having fun. Many websites offer free typing games. Some track your progress over time. Playing these games can improve your skills.";
-        paragraphs[9] = "In today's world, typing is a basic skill everyone needs. Many jobs require good typing skills. Schools teach typing to prepare students. The faster you can type, the more productive you can be. It's a skill that will help you throughout life.";
-        selectRandomParagraph();
+        BeginTextureMode(paragraphTexture);
+        textFont.begin();
+        for (auto it = first; it != words.end() && it->start <= high; ++it)
+        {
+            int key = paintKey(*it, pos);
+            if (isLineVisible(it->line) && it->painted != key)
+                paintWord(*it, key, true);
+        }
+        textFont.end();
+        EndTextureMode();
+
+        paintedPosition = pos;
+        paintedMistakes = mistakes;
     }
-};
 
-class MediumMode : public TextMode
-{
-public:
-    MediumMode()
+    void buildGlyphs()
     {
-        paragraphs[0] = "Programming creates computer instructions using various languages. Each language has unique syntax and rules. Understanding these rules is essential for coding. Practice helps develop programming skills. Good programmers write clean, efficient code.";
-        paragraphs[1] = "Computer science studies computers and computational systems. It combines theory and practical applications. Computer scientists develop new technologies. The field evolves with new innovations. Understanding CS is vital for modern technology.";
-        paragraphs[2] = "Algorithms are step-by-step problem-solving procedures. They are fundamental to programming. Good algorithms are efficient and correct. Understanding algorithms improves coding skills. Many problems use standard algorithms.";
-        paragraphs[3] = "Data structures organize and store computer data. They enable efficient data access. Common structures include arrays and lists. Choosing the right structure is crucial. Understanding structures is key to programming.";
-        paragraphs[4] = "Software development creates computer programs. It involves coding and testing. Good software is reliable and user-friendly. The process includes planning and maintenance. Teamwork is important in development.";
-        paragraphs[5] = "The internet is a global network of computers. It enables information sharing worldwide. The web contains websites and pages. Understanding the internet is crucial. Security is vital for internet usage.";
-        paragraphs[6] = "Artificial intelligence simulates human intelligence. It includes learning and reasoning. AI systems perform complex tasks. Machine learning is an AI subset. AI is important in modern technology.";
-        paragraphs[7] = "Cybersecurity protects systems from digital attacks. It's crucial in our connected world. Good security prevents data breaches. Understanding security is important. Strong passwords are essential.";
-        paragraphs[8] = "Cloud computing provides resources over the internet. It offers flexibility and scalability. Users access data from anywhere. Cloud services are popular. Understanding cloud computing is important.";
-        paragraphs[9] = "Mobile apps are essential in daily life. They help communication and work. Developing apps requires platform knowledge. Good apps are user-friendly. The app market continues growing.";
-        selectRandomParagraph();
+        paragraphFont = textFont.load() ? textFont.getFont() : GetFontDefault();
+        glyphs.reset(paragraphFont.baseSize);
+        for (int i = 0; i < paragraphFont.glyphCount; i++)
+        {
+            const GlyphInfo &glyph = paragraphFont.glyphs[i];
+            glyphs.add(glyph.value, glyph.advanceX != 0 ? (float)glyph.advanceX : paragraphFont.recs[i].width + glyph.offsetX);
+        }
+        glyphs.finish();
     }
-};
 
-class HardMode : public TextMode
-{
-public:
-    HardMode()
+    void rebuildLayout()
     {
-        paragraphs[0] = "OOP utilizes encapsulation, inheritance, and polymorphism. Classes define object types and behaviors. Inheritance creates hierarchical relationships. Polymorphism enables flexible object handling. Abstraction hides complex details.";
-        paragraphs[1] = "Machine learning processes vast datasets, identifying patterns. Deep learning excels at image recognition. NLP analyzes linguistic structures. Reinforcement learning optimizes decisions. These technologies revolutionize automation.";
-        paragraphs[2] = "Quantum computing uses superposition and entanglement. Qubits exist in multiple states. Quantum algorithms solve problems faster. Decoherence challenges quantum states. Error correction mitigates quantum noise.";
-        paragraphs[3] = "Blockchain uses cryptographic hashing and signatures. Smart contracts execute automatically. Consensus mechanisms validate transactions. Distributed ledgers maintain records. Cryptocurrencies use blockchain securely.";
-        paragraphs[4] = "Neural networks process through artificial neurons. Backpropagation adjusts connection weights. Activation functions add non-linearity. Convolutional layers extract features. Recurrent networks handle sequences.";
-        paragraphs[5] = "IoT integrates sensors and protocols. Edge computing reduces latency. Security needs encryption. Standards ensure device communication. Predictive maintenance uses IoT data.";
-        paragraphs[6] = "VR uses displays and motion tracking. Haptic feedback enhances interaction. Spatial audio simulates sound. Latency reduction prevents sickness. VR spans training and entertainment.";
-        paragraphs[7] = "AR overlays digital information. Tracking systems enable interactions. Vision algorithms detect objects. Displays project virtual content. AR aids navigation and education.";
-        paragraphs[8] = "Big data processes high-velocity datasets. MapReduce parallelizes processing. NoSQL handles unstructured data. Mining extracts insights. Privacy techniques protect information.";
-        paragraphs[9] = "Cybersecurity uses defense-in-depth strategies. IDS monitors network traffic. Cryptography secures communication. Zero-trust verifies access. Response plans handle breaches.";
-        selectRandomParagraph();
-    }
-};
+        if (!glyphs.isBuilt())
+            buildGlyphs();
 
-class TypingTracker
-{
-private:
-    TextMode *currentMode;
-    int selectedMode;
-    int screenWidth;
-    int screenHeight;
-    float scaleFactor;
-    int fontSize;
-    int lineHeight;
-    int margin;
-    int textAreaWidth;
-    int textAreaHeight;
-    int textY;
-    int maxVisibleLines;
-    int currentScroll;
-    int visibleLines;
+        // Words are split and measured on the decoded codepoints, never on the UTF-8 bytes
+        int scaledMargin = (int)(margin * scaleFactor);
+        spaceWidth = layoutWords(currentMode->getCodepoints(), currentMode->getLength(), glyphs, textSize(), textSpacing(),
+                                 scaledMargin, screenWidth - scaledMargin, words, lines);
+
+        layoutSource = currentMode->getText();
+        layoutDirty = false;
+        textureDirty = true;
+        currentScroll = 0;
+    }
 
 public:
-    TypingTracker() : selectedMode(0), screenWidth(800), screenHeight(600),
+    TypingTracker(const ParagraphCorpus *paragraphCorpus = nullptr)
+        : keyLog("keystrokes.log"), history("history.dat"), corpus(paragraphCorpus), selectedMode(0), screenWidth(800), screenHeight(600),
                       scaleFactor(1.0f), fontSize(20), lineHeight(30), margin(20),
                       textAreaWidth(0), textAreaHeight(0), textY(0), maxVisibleLines(0),
-                      currentScroll(0), visibleLines(0)
+                      currentScroll(0), visibleLines(0), paragraphFont(), layoutSource(nullptr), layoutDirty(true),
+                      needsRedraw(true), lastTimerTick(-1), paragraphTexture(), textureDirty(true),
+                      paintedPosition(0), paintedMistakes(0), spaceWidth(0)
     {
+#ifdef TST_RACES
+        race = nullptr;
+#endif
         srand(time(NULL));
-        currentMode = new EasyMode();
+        history.open("history.idx");
+        modes[0] = &easyMode;
+        modes[1] = &mediumMode;
+        modes[2] = &hardMode;
+        modes[3] = &marathonMode;
+        for (TextMode *mode : modes)
+        {
+            mode->setClock(&clock);
+            mode->setKeystrokeLog(&keyLog);
+            mode->setCorpus(corpus);
+            mode->setHistory(&history);
+            mode->setWeaknessModel(&weakness);
+            mode->selectRandomParagraph();
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            modes[i]->buildDrillIndex();
+        }
+        currentMode = modes[0];
+    }
+
+    // Enables the Marathon button with the text of the given file
+    bool loadMarathonText(const char *path)
+    {
+        return marathonMode.load(path);
     }
 
+    // Must run while the window (and its GL context) is still open
     ~TypingTracker()
     {
-        delete currentMode;
+        if (paragraphTexture.id != 0)
+            UnloadRenderTexture(paragraphTexture);
+        textFont.unload();
     }
 
     void updateScreenSize(int width, int height)
@@ -279,7 +347,103 @@ public:
         textY = topSectionHeight + (availableHeight / 4);
 
         maxVisibleLines = textAreaHeight / scaledLineHeight;
-        visibleLines = maxVisibleLines;
+        // The text starts a quarter of the way down the text area
+        visibleLines = std::max(1, (screenHeight - bottomSectionHeight - textY) / scaledLineHeight);
+        layoutDirty = true;
+        needsRedraw = true;
+    }
+
+    void requestRedraw() { needsRedraw = true; }
+
+    FrameProfiler &getProfiler() { return profiler; }
+
+#ifdef TST_RACES
+    // Replaces the latency column with the race standings: our rank, then the leaders
+    void drawRaceStandings(int x, int y, int lineHeight, int size)
+    {
+        const RaceStandingsHeader &header = race->getStandings();
+        char text[80];
+        int ownRank = 0;
+        for (int i = 0; i < header.count; i++)
+        {
+            if (race->getRow(i).playerId == race->getPlayerId())
+                ownRank = race->getRow(i).rank;
+        }
+        sprintf(text, "Race: %d of %d%s", ownRank, header.players, race->isRacing() ? "" : " (finished)");
+        DrawText(text, x, y, size, MAROON);
+        for (int i = 0; i < header.count && i < 3; i++)
+        {
+            const RaceStanding &row = race->getRow(i);
+            sprintf(text, "%d. %.15s  %.1f WPM%s", row.rank, row.name, row.wpmTenths / 10.0f, row.finished ? " *" : "");
+            DrawText(text, x, y + (i + 1) * lineHeight, size, row.playerId == race->getPlayerId() ? MAROON : BLACK);
+        }
+    }
+#endif
+
+    // Frame time, input-to-display latency and the phases of the last frame (F3 toggles)
+    void drawProfilerOverlay()
+    {
+        int overlayFontSize = (int)(14 * scaleFactor);
+        int overlayLineHeight = overlayFontSize + 4;
+        int x = screenWidth - (int)(260 * scaleFactor);
+        int y = (int)(margin * scaleFactor);
+        int frameCount = profiler.getFrameCount();
+
+        DrawRectangle(x - 8, y - 6, screenWidth - x, (PHASE_COUNT + 3) * overlayLineHeight + 8, Color{0, 0, 0, 180});
+
+        float averageMs, p99Ms, latencyMs;
+        profiler.getFrameStats(averageMs, p99Ms, latencyMs);
+        char line[80];
+        sprintf(line, "Frame: %.2f ms avg, %.2f ms p99", averageMs, p99Ms);
+        DrawText(line, x, y, overlayFontSize, WHITE);
+        sprintf(line, "Input to display: %.1f ms", latencyMs);
+        DrawText(line, x, y + overlayLineHeight, overlayFontSize, WHITE);
+        sprintf(line, "%d frames, F4 exports a trace", frameCount);
+        DrawText(line, x, y + 2 * overlayLineHeight, overlayFontSize, WHITE);
+
+        if (frameCount == 0)
+            return;
+        const FrameTiming &last = profiler.getFrame(0);
+        for (int phase = 0; phase < PHASE_COUNT; phase++)
+        {
+            sprintf(line, "%s: %.3f ms", FrameProfiler::phaseName(phase), last.phaseMs[phase]);
+            DrawText(line, x, y + (3 + phase) * overlayLineHeight, overlayFontSize, LIGHTGRAY);
+        }
+    }
+
+    // Remaining time for timed modes, elapsed time for untimed ones
+    float displayedTime()
+    {
+        return currentMode->getTimeLimit() > 0 ? currentMode->getRemainingTime() : currentMode->getElapsedTime();
+    }
+
+    // True while the countdown runs, i.e. while the scene changes on its own
+    bool isTimerRunning()
+    {
+        return currentMode->getIsTyping() && !currentMode->isComplete();
+    }
+
+#ifdef TST_RACES
+    void setRaceClient(RaceClient *client) { race = client; }
+
+    // Standings and the start arrive over the network, which does not wake the event loop
+    bool isRaceActive() { return race && race->isConnected() && (race->isWaiting() || race->isRacing()); }
+#else
+    bool isRaceActive() { return false; }
+#endif
+
+    // Returns whether the scene must be repainted this frame and clears the request
+    bool consumeRedraw()
+    {
+        long timerTick = lround(displayedTime() * 10.0f);
+        if (timerTick != lastTimerTick)
+        {
+            lastTimerTick = timerTick;
+            needsRedraw = true;
+        }
+        bool redraw = needsRedraw;
+        needsRedraw = false;
+        return redraw;
     }
 
     void draw()
@@ -307,61 +471,39 @@ public:
         DrawRectangle(scaledMargin, startButtonY, startButtonWidth, startButtonHeight, LIGHTGRAY);
         DrawText("Start", scaledMargin + 20, startButtonY + 10, scaledFontSize, BLACK);
 
+        int nextButtonX = scaledMargin + startButtonWidth + scaledMargin;
+        DrawRectangle(nextButtonX, startButtonY, startButtonWidth, startButtonHeight, LIGHTGRAY);
+        DrawText("Next", nextButtonX + 20, startButtonY + 10, scaledFontSize, BLACK);
+
+        if (marathonMode.isLoaded())
+        {
+            int marathonButtonX = nextButtonX + startButtonWidth + scaledMargin;
+            int marathonButtonWidth = (int)(150 * scaleFactor);
+            DrawRectangle(marathonButtonX, startButtonY, marathonButtonWidth, startButtonHeight, LIGHTGRAY);
+            DrawText("Marathon", marathonButtonX + 20, startButtonY + 10, scaledFontSize, selectedMode == 3 ? RED : BLACK);
+        }
+
         char timerText[20];
-        sprintf(timerText, "Time: %.1f", currentMode->getRemainingTime());
+        bool timed = currentMode->getTimeLimit() > 0;
+        sprintf(timerText, "Time: %.1f", displayedTime());
         DrawText(timerText, scaledMargin, startButtonY + startButtonHeight + scaledMargin,
-                 scaledFontSize, currentMode->getRemainingTime() < 5.0f ? RED : BLACK);
-
-        const char *text = currentMode->getText();
-        int pos = currentMode->getCurrentPosition();
-        int currentLine = 0;
-        int currentX = scaledMargin;
-        int currentY = textY;
-        int wordStart = 0;
-        int wordEnd = 0;
-        bool inWord = false;
+                 scaledFontSize, timed && currentMode->getRemainingTime() < 5.0f ? RED : BLACK);
 
-        for (int i = 0; i <= strlen(text); i++)
         {
-            if (text[i] == ' ' || text[i] == '\0')
+            PROFILE_SCOPE(profiler, PHASE_LAYOUT);
+            if (layoutDirty || currentMode->getText() != layoutSource)
             {
-                if (inWord)
-                {
-                    wordEnd = i;
-                    const char *word = TextSubtext(text, wordStart, wordEnd - wordStart);
-                    int wordWidth = MeasureText(word, scaledFontSize);
-
-                    if (currentX + wordWidth > screenWidth - scaledMargin)
-                    {
-                        currentX = scaledMargin;
-                        currentY += scaledLineHeight;
-                        currentLine++;
-                    }
-
-                    Color wordColor;
-                    if (wordEnd <= pos)
-                    {
-                        wordColor = GREEN; // Already typed
-                    }
-                    else if (wordStart <= pos && pos < wordEnd)
-                    {
-                        wordColor = BLUE; // Current word
-                    }
-                    else
-                    {
-                        wordColor = GRAY; // Upcoming text
-                    }
-
-                    DrawText(word, currentX, currentY, scaledFontSize, wordColor);
-                    currentX += wordWidth + MeasureText(" ", scaledFontSize);
-                    inWord = false;
-                }
-            }
-            else if (!inWord)
-            {
-                wordStart = i;
-                inWord = true;
+                rebuildLayout();
             }
+
+            updateScroll();
+            updateParagraphTexture();
+        }
+        if (paragraphTexture.id != 0)
+        {
+            // Render textures are stored upside down, hence the negative height
+            Rectangle source = {0, 0, (float)paragraphTexture.texture.width, -(float)paragraphTexture.texture.height};
+            DrawTextureRec(paragraphTexture.texture, source, Vector2{0, (float)textY}, WHITE);
         }
 
         // Draw statistics
@@ -372,7 +514,7 @@ public:
             char accuracyText[50];
             char mistakesText[50];
 
-            sprintf(wpmText, "WPM: %.1f", currentMode->getWPM());
+            sprintf(wpmText, "WPM: %.1f (avg %.1f)", currentMode->getRollingWPM(), currentMode->getWPM());
             sprintf(cpmText, "CPM: %.1f", currentMode->getCPM());
             sprintf(accuracyText, "Accuracy: %.1f%%", currentMode->getAccuracy());
             sprintf(mistakesText, "Mistakes: %d", currentMode->getMistakes());
@@ -382,11 +524,66 @@ public:
             DrawText(cpmText, scaledMargin, statsY + scaledLineHeight, scaledFontSize, BLACK);
             DrawText(accuracyText, scaledMargin, statsY + 2 * scaledLineHeight, scaledFontSize, BLACK);
             DrawText(mistakesText, scaledMargin, statsY + 3 * scaledLineHeight, scaledFontSize, BLACK);
+
+#ifdef TST_RACES
+            bool showRace = race && race->hasStandings();
+            if (showRace)
+                drawRaceStandings(screenWidth / 2, statsY, scaledLineHeight, scaledFontSize);
+#else
+            bool showRace = false;
+#endif
+
+            // Inter-key latency percentiles in a second column
+            LatencyHistogram &latency = currentMode->getLatency();
+            if (!showRace && latency.getCount() > 0)
+            {
+                char latencyText[3][50];
+                sprintf(latencyText[0], "Key p50: %.0f ms", latency.getP50());
+                sprintf(latencyText[1], "Key p95: %.0f ms", latency.getP95());
+                sprintf(latencyText[2], "Key p99: %.0f ms", latency.getP99());
+                for (int i = 0; i < 3; i++)
+                {
+                    DrawText(latencyText[i], screenWidth / 2, statsY + i * scaledLineHeight, scaledFontSize, BLACK);
+                }
+            }
+
+            // Personal record for this mode, read from the history summary
+            const ModeSummary *modeHistory = history.getMode(currentMode->getModeId());
+            if (!showRace && currentMode->isComplete() && modeHistory && modeHistory->count > 0)
+            {
+                char historyText[80];
+                sprintf(historyText, "Best: %.1f  Mean: %.1f WPM", modeHistory->bestWPM,
+                        history.getMeanWPM(currentMode->getModeId()));
+                DrawText(historyText, screenWidth / 2, statsY + 3 * scaledLineHeight, scaledFontSize, BLACK);
+            }
+        }
+
+#ifdef TST_RACES
+        if (race && race->isWaiting())
+        {
+            DrawText("Waiting for the race to start...", scaledMargin, screenHeight - (int)(120 * scaleFactor),
+                     scaledFontSize, MAROON);
+        }
+#endif
+
+        if (profiler.isEnabled())
+        {
+            drawProfilerOverlay();
         }
     }
 
     void handleInput()
     {
+        if (IsKeyPressed(KEY_F3))
+        {
+            profiler.setEnabled(!profiler.isEnabled());
+            needsRedraw = true;
+        }
+        if (IsKeyPressed(KEY_F4) && profiler.isEnabled())
+        {
+            profiler.exportChromeTrace("profile_trace.json");
+        }
+
         if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
         {
             Vector2 mousePos = GetMousePosition();
@@ -400,6 +597,9 @@ public:
             int startButtonHeight = (int)(40 * scaleFactor);
             int buttonY = scaledMargin;
             int startButtonY = buttonY + buttonHeight + scaledMargin;
+            int nextButtonX = scaledMargin + startButtonWidth + scaledMargin;
+            int marathonButtonX = nextButtonX + startButtonWidth + scaledMargin;
+            int marathonButtonWidth = (int)(150 * scaleFactor);
 
             // Check mode selection buttons
             if (mousePos.x >= scaledMargin && mousePos.x <= scaledMargin + buttonWidth &&
@@ -423,31 +623,61 @@ public:
             else if (mousePos.x >= scaledMargin && mousePos.x <= scaledMargin + startButtonWidth &&
                      mousePos.y >= startButtonY && mousePos.y <= startButtonY + startButtonHeight)
             {
+#ifdef TST_RACES
+                // Connected to a race server, Start enters the next race of the selected mode
+                if (race && race->isConnected() && selectedMode < 3)
+                {
+                    race->join(selectedMode);
+                    needsRedraw = true;
+                    return;
+                }
+#endif
                 currentMode->startGame();
+                needsRedraw = true;
+            }
+            // Next paragraph, chosen to drill weak bigrams once enough keys were typed
+            else if (mousePos.x >= nextButtonX && mousePos.x <= nextButtonX + startButtonWidth &&
+                     mousePos.y >= startButtonY && mousePos.y <= startButtonY + startButtonHeight)
+            {
+                switchMode(selectedMode);
+            }
+            else if (marathonMode.isLoaded() &&
+                     mousePos.x >= marathonButtonX && mousePos.x <= marathonButtonX + marathonButtonWidth &&
+                     mousePos.y >= startButtonY && mousePos.y <= startButtonY + startButtonHeight)
+            {
+                switchMode(3);
             }
         }
     }
 
     void switchMode(int mode)
     {
-        delete currentMode;
         selectedMode = mode;
-        switch (mode)
-        {
-        case 0:
-            currentMode = new EasyMode();
-            break;
-        case 1:
-            currentMode = new MediumMode();
-            break;
-        case 2:
-            currentMode = new HardMode();
-            break;
-        }
+        currentMode = modes[mode];
+        currentMode->selectRandomParagraph();
+        layoutDirty = true;
+        needsRedraw = true;
     }
 
     void update()
     {
+#ifdef TST_RACES
+        if (race)
+        {
+            if (race->poll())
+                needsRedraw = true;
+            // Everyone in the race types the same passage, starting now
+            RaceStart start;
+            if (race->takeStart(start) && start.mode < 3)
+            {
+                selectedMode = start.mode;
+                currentMode = modes[start.mode];
+                currentMode->selectParagraph((int)start.paragraph);
+                currentMode->startGame();
+                layoutDirty = true;
+            }
+        }
+#endif
         currentMode->updateTimer();
 
         if (!currentMode->getIsTyping() && currentMode->getIsStarted())
@@ -455,16 +685,165 @@ public:
             currentMode->startTyping();
         }
 
+        // Drain every key queued since the last frame so fast typing is not capped by the frame rate
+        double keyTime = clock.now();
         int key = GetCharPressed();
-        if (key != 0)
+        while (key != 0)
         {
-            currentMode->checkInput(key);
+            currentMode->checkInput(key, keyTime);
+#ifdef TST_RACES
+            if (race)
+                race->addKey(key);
+#endif
+            profiler.markInput();
+            needsRedraw = true;
+            key = GetCharPressed();
         }
+#ifdef TST_RACES
+        if (race)
+            race->flush();
+#endif
     }
 };
+// Re-scores every session of a keystroke log without opening a window
+// (pass the corpus and marathon text the sessions were typed from, if any)
+int replayKeystrokeLog(const char *path, const ParagraphCorpus *corpus, const char *marathonPath)
+{
+    static const char *outcomeNames[] = {"outcome not logged", "completed", "timed out", "abandoned"};
+
+    KeystrokeLogReader reader;
+    if (!reader.open(path))
+    {
+        fprintf(stderr, "Cannot open keystroke log %s\n", path);
+        return 1;
+    }
+
+    ManualClock replayClock;
+    EasyMode easy;
+    MediumMode medium;
+    HardMode hard;
+    MarathonMode marathon;
+    if (marathonPath)
+        marathon.load(marathonPath);
+    TextMode *modes[4] = {&easy, &medium, &hard, &marathon};
+    for (TextMode *mode : modes)
+        mode->setCorpus(corpus);
+
+    KeystrokeSession session;
+    int sessionCount = 0;
+    while (reader.nextSession(session))
+    {
+        if (session.mode < 0 || session.mode > 3 || session.paragraph < 0 ||
+            session.paragraph >= modes[session.mode]->getParagraphCount())
+            continue;
+
+        TextMode *mode = modes[session.mode];
+        replaySession(*mode, replayClock, session);
+
+        sessionCount++;
+        printf("Session %d: mode %d, paragraph %d, %s, %d/%d chars, WPM %.1f, CPM %.1f, accuracy %.1f%%, mistakes %d\n",
+               sessionCount, session.mode, session.paragraph, outcomeNames[session.outcome], mode->getCurrentPosition(),
+               mode->getLength(), mode->getWPM(), mode->getCPM(), mode->getAccuracy(), mode->getMistakes());
+    }
+    return 0;
+}
+
+// Prints the per-mode aggregates and leaderboards of the session history
+int printHistory()
+{
+    static const char *modeNames[HISTORY_MODES] = {"Easy", "Medium", "Hard", "Marathon"};
+
+    SessionHistory history("history.dat");
+    if (!history.open("history.idx"))
+    {
+        fprintf(stderr, "Cannot open the session history\n");
+        return 1;
+    }
+
+    for (int mode = 0; mode < HISTORY_MODES; mode++)
+    {
+        const ModeSummary *stats = history.getMode(mode);
+        if (stats->count == 0)
+            continue;
+        printf("%s: %u sessions, mean %.1f WPM, best %.1f WPM, p50 %.0f, p90 %.0f, mean accuracy %.1f%%\n",
+               modeNames[mode], stats->count, history.getMeanWPM(mode), stats->bestWPM,
+               history.getPercentileWPM(mode, 0.5f), history.getPercentileWPM(mode, 0.9f),
+               history.getMeanAccuracy(mode));
+        for (uint32_t i = 0; i < stats->topCount; i++)
+        {
+            printf("  #%u  %.1f WPM  %.1f%%  (session %llu)\n", i + 1, stats->top[i].wpm, stats->top[i].accuracy,
+                   (unsigned long long)stats->top[i].recordIndex);
+        }
+    }
+    return 0;
+}
+
 // Main
-int main()
+int main(int argc, char **argv)
 {
+    const char *corpusPath = nullptr;
+    const char *replayPath = nullptr;
+    const char *marathonPath = nullptr;
+    bool continuousRendering = false;
+    const char *raceAddress = nullptr;
+    const char *raceName = getenv("USER");
+    const char *raceRoom = "";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--build-corpus") == 0 && i + 2 < argc)
+        {
+            if (!ParagraphCorpus::build(argv[i + 1], argv[i + 2]))
+            {
+                fprintf(stderr, "Cannot build corpus %s from %s\n", argv[i + 2], argv[i + 1]);
+                return 1;
+            }
+            return 0;
+        }
+        else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+        {
+            corpusPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--marathon") == 0 && i + 1 < argc)
+        {
+            marathonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--history") == 0)
+        {
+            return printHistory();
+        }
+        else if (strcmp(argv[i], "--continuous") == 0)
+        {
+            continuousRendering = true;
+        }
+        else if (strcmp(argv[i], "--race") == 0 && i + 1 < argc)
+        {
+            raceAddress = argv[++i];
+        }
+        else if (strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+        {
+            raceName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--room") == 0 && i + 1 < argc)
+        {
+            raceRoom = argv[++i];
+        }
+    }
+
+    ParagraphCorpus corpus;
+    if (corpusPath && !corpus.open(corpusPath))
+    {
+        fprintf(stderr, "Cannot open corpus %s, using the built-in paragraphs\n", corpusPath);
+    }
+
+    if (replayPath)
+    {
+        return replayKeystrokeLog(replayPath, &corpus, marathonPath);
+    }
+
     const int initialWidth = 1000;
     const int initialHeight = 700;
 
@@ -472,22 +851,89 @@ int main()
     SetTargetFPS(60);
     SetWindowState(FLAG_WINDOW_RESIZABLE);
 
-    TypingTracker tracker;
-
-    while (!WindowShouldClose())
+    // Scoped so the tracker releases its GPU resources before the window closes
     {
-        if (IsWindowResized())
+        TypingTracker tracker(&corpus);
+        tracker.updateScreenSize(GetScreenWidth(), GetScreenHeight());
+        if (marathonPath && !tracker.loadMarathonText(marathonPath))
+        {
+            fprintf(stderr, "Cannot load marathon text %s\n", marathonPath);
+        }
+#ifdef TST_RACES
+        RaceClient raceClient;
+        if (raceAddress)
         {
-            tracker.updateScreenSize(GetScreenWidth(), GetScreenHeight());
+            if (raceClient.connect(raceAddress, raceName ? raceName : "player", raceRoom))
+                tracker.setRaceClient(&raceClient);
+            else
+                fprintf(stderr, "Cannot connect to the race server at %s\n", raceAddress);
         }
+#else
+        if (raceAddress)
+            fprintf(stderr, "Races are not supported on this platform\n");
+#endif
+        bool wasFocused = IsWindowFocused();
+
+        FrameProfiler &profiler = tracker.getProfiler();
+
+        while (!WindowShouldClose())
+        {
+            profiler.beginFrame();
+            if (IsWindowResized())
+            {
+                tracker.updateScreenSize(GetScreenWidth(), GetScreenHeight());
+            }
+            if (IsWindowFocused() != wasFocused)
+            {
+                // The window may have been covered or restored
+                wasFocused = !wasFocused;
+                tracker.requestRedraw();
+            }
 
-        tracker.handleInput();
-        tracker.update();
+            {
+                PROFILE_SCOPE(profiler, PHASE_INPUT);
+                tracker.handleInput();
+            }
+            {
+                PROFILE_SCOPE(profiler, PHASE_UPDATE);
+                tracker.update();
+            }
 
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
-        tracker.draw();
-        EndDrawing();
+            // With nothing animating, sleep until the next input event instead of polling.
+            // The overlay polls too, as EndDrawing would otherwise count that sleep as present time.
+            bool timerRunning = tracker.isTimerRunning() || tracker.isRaceActive();
+            bool polling = timerRunning || profiler.isEnabled();
+            if (polling || continuousRendering)
+                DisableEventWaiting();
+            else
+                EnableEventWaiting();
+
+            bool presented = tracker.consumeRedraw() || continuousRendering;
+            if (presented)
+            {
+                BeginDrawing();
+                ClearBackground(RAYWHITE);
+                {
+                    PROFILE_SCOPE(profiler, PHASE_DRAW);
+                    tracker.draw();
+                }
+                {
+                    // EndDrawing also waits for the frame rate and polls the next input events
+                    PROFILE_SCOPE(profiler, PHASE_PRESENT);
+                    EndDrawing();
+                }
+                profiler.markPoll();
+            }
+            else
+            {
+                // Nothing changed: keep the last frame on screen and just process input
+                PollInputEvents();
+                profiler.markPoll();
+                if (polling)
+                    WaitTime(1.0 / 60.0);
+            }
+            profiler.endFrame(presented);
+        }
     }
 
     CloseWindow();
@@ -0,0 +1,390 @@
+// Synthetic clients for load-testing the race server. Each thread drives its
+// share of the clients from one epoll loop: they join races, type the passage
+// at a set speed with a set error rate, send their keys in batches, and time
+// how long it takes until the server's standings show each batch.
+// Linux only (epoll).
+#include "RaceProtocol.h"
+#include "TypingCore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <sys/epoll.h>
+#include <thread>
+#include <vector>
+
+double now()
+{
+    static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+struct LoadConfig
+{
+    const char *address;
+    int clients;
+    int threads;
+    int mode;
+    int races; // per client
+    double wpm;
+    double errorRate;
+    double batchSeconds;
+    double timeout;
+    unsigned int seed;
+    const char *room;
+    const ParagraphCorpus *corpus;
+};
+
+struct Client
+{
+    RaceConnection connection;
+    int index;
+    uint32_t playerId;
+    int racesLeft;
+    bool typing;
+    std::unique_ptr<TextMode> passage;
+    int typed;
+    double nextKey;
+    std::vector<uint32_t> batch;
+    std::deque<std::pair<int, double>> pending; // position a batch reaches, and when it was sent
+};
+
+// Results of one thread
+struct LoadResult
+{
+    uint64_t connected = 0;
+    uint64_t keys = 0;
+    uint64_t standings = 0;
+    uint64_t racesDone = 0;
+    uint64_t failures = 0;
+    std::vector<float> latencies; // seconds from sending a batch to seeing it in the standings
+};
+
+TextMode *makePassage(int mode)
+{
+    switch (mode)
+    {
+    case 1:
+        return new MediumMode();
+    case 2:
+        return new HardMode();
+    default:
+        return new EasyMode();
+    }
+}
+
+class LoadThread
+{
+private:
+    const LoadConfig &config;
+    std::mt19937 random;
+    std::vector<std::unique_ptr<Client>> clients;
+    int epollFd;
+    int active;
+
+    bool sendJoin(Client &client)
+    {
+        RaceJoin join = {};
+        join.mode = (uint8_t)config.mode;
+        char name[RACE_NAME_LENGTH];
+        snprintf(name, sizeof(name), "bot%d", client.index);
+        copyRaceName(join.name, name);
+        copyRaceName(join.room, config.room);
+        return client.connection.send(RACE_JOIN, &join, sizeof(join)) && client.connection.flush();
+    }
+
+    // Time between keys at the configured speed, with some jitter
+    double keyInterval()
+    {
+        std::uniform_real_distribution<double> jitter(0.7, 1.3);
+        return 60.0 / (config.wpm * 5.0) * jitter(random);
+    }
+
+    void onStart(Client &client, const RaceStart &start)
+    {
+        client.playerId = start.playerId;
+        client.passage.reset(makePassage(start.mode));
+        client.passage->setCorpus(config.corpus);
+        client.passage->selectParagraph((int)start.paragraph);
+        client.typed = 0;
+        client.typing = true;
+        client.nextKey = now() + keyInterval();
+        client.pending.clear();
+    }
+
+    void onStandings(Client &client, const uint8_t *data, size_t length, LoadResult &result)
+    {
+        if (length < sizeof(RaceStandingsHeader))
+            return;
+        RaceStandingsHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (length < sizeof(header) + header.count * sizeof(RaceStanding))
+            return;
+        result.standings++;
+        double received = now();
+        for (int i = 0; i < header.count; i++)
+        {
+            RaceStanding row;
+            memcpy(&row, data + sizeof(header) + i * sizeof(RaceStanding), sizeof(row));
+            if (row.playerId != client.playerId)
+                continue;
+            while (!client.pending.empty() && client.pending.front().first <= (int)row.position)
+            {
+                result.latencies.push_back((float)(received - client.pending.front().second));
+                client.pending.pop_front();
+            }
+        }
+    }
+
+    // Returns false if the client broke
+    bool receive(Client &client, LoadResult &result)
+    {
+        if (!client.connection.receive())
+            return false;
+        RaceHeader header;
+        const uint8_t *data;
+        while (client.connection.next(header, data))
+        {
+            if (header.type == RACE_START && header.length == sizeof(RaceStart))
+            {
+                RaceStart start;
+                memcpy(&start, data, sizeof(start));
+                onStart(client, start);
+            }
+            else if (header.type == RACE_STANDINGS)
+            {
+                onStandings(client, data, header.length, result);
+            }
+            else if (header.type == RACE_FINISHED)
+            {
+                onStandings(client, data, header.length, result);
+                client.typing = false;
+                result.racesDone++;
+                if (--client.racesLeft > 0)
+                {
+                    if (!sendJoin(client))
+                        return false;
+                }
+                else
+                {
+                    active--;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Queues every key that is due by now and sends them as one batch
+    bool type(Client &client, double time, LoadResult &result)
+    {
+        if (!client.typing)
+            return true;
+        const int *text = client.passage->getCodepoints();
+        int length = client.passage->getLength();
+        std::bernoulli_distribution mistake(config.errorRate);
+        client.batch.clear();
+        while (client.nextKey <= time && client.typed < length && (int)client.batch.size() < RACE_MAX_KEYS)
+        {
+            int expected = text[client.typed];
+            if (mistake(random))
+            {
+                client.batch.push_back(expected == '#' ? '~' : '#');
+            }
+            else
+            {
+                client.batch.push_back((uint32_t)expected);
+                client.typed++;
+            }
+            client.nextKey += keyInterval();
+        }
+        if (client.batch.empty())
+            return true;
+
+        result.keys += client.batch.size();
+        client.pending.push_back(std::make_pair(client.typed, time));
+        return client.connection.send(RACE_KEYS, client.batch.data(), client.batch.size() * 4) &&
+               client.connection.flush();
+    }
+
+public:
+    LoadThread(const LoadConfig &loadConfig, int threadIndex)
+        : config(loadConfig), random(loadConfig.seed + threadIndex), epollFd(epoll_create1(0)), active(0)
+    {
+    }
+
+    ~LoadThread() { close(epollFd); }
+
+    void addClient(int index)
+    {
+        std::unique_ptr<Client> client(new Client());
+        client->index = index;
+        client->playerId = 0;
+        client->racesLeft = config.races;
+        client->typing = false;
+        client->typed = 0;
+        client->nextKey = 0;
+        clients.push_back(std::move(client));
+    }
+
+    void run(LoadResult &result)
+    {
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            Client &client = *clients[i];
+            int fd = raceConnect(config.address);
+            if (fd < 0)
+            {
+                result.failures++;
+                continue;
+            }
+            client.connection.open(fd);
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.u64 = i;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            if (!sendJoin(client))
+            {
+                client.connection.close();
+                result.failures++;
+                continue;
+            }
+            result.connected++;
+            active++;
+        }
+
+        epoll_event events[256];
+        double deadline = now() + config.timeout;
+        double nextBatch = now();
+        while (active > 0 && now() < deadline)
+        {
+            int timeout = (int)std::max(0.0, (nextBatch - now()) * 1000.0);
+            int count = epoll_wait(epollFd, events, 256, timeout);
+            for (int i = 0; i < count; i++)
+            {
+                Client &client = *clients[events[i].data.u64];
+                if (client.connection.isOpen() && !receive(client, result))
+                {
+                    client.connection.close();
+                    result.failures++;
+                    active--;
+                }
+            }
+
+            double time = now();
+            if (time >= nextBatch)
+            {
+                for (auto &client : clients)
+                {
+                    if (client->connection.isOpen() && !type(*client, time, result))
+                    {
+                        client->connection.close();
+                        result.failures++;
+                        active--;
+                    }
+                }
+                nextBatch = time + config.batchSeconds;
+            }
+        }
+    }
+};
+
+float percentile(std::vector<float> &values, double fraction)
+{
+    if (values.empty())
+        return 0;
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+int main(int argc, char **argv)
+{
+    LoadConfig config = {RACE_DEFAULT_ADDRESS, 1000, (int)std::thread::hardware_concurrency(), 0, 1, 80.0, 0.02, 0.05,
+                         120.0, 1, "", nullptr};
+    const char *corpusPath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            config.address = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            config.clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            config.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            config.mode = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            config.races = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--wpm") == 0 && i + 1 < argc)
+            config.wpm = atof(argv[++i]);
+        else if (strcmp(argv[i], "--errors") == 0 && i + 1 < argc)
+            config.errorRate = atof(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            config.batchSeconds = atof(argv[++i]) / 1000.0;
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            config.timeout = atof(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            config.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--room") == 0 && i + 1 < argc)
+            config.room = argv[++i];
+        else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+            corpusPath = argv[++i];
+        else
+        {
+            fprintf(stderr,
+                    "Usage: %s [-a address] [-c clients] [-j threads] [-m mode] [-n races] [--wpm n] [--errors rate]\n"
+                    "          [-b batch_ms] [-t timeout_s] [-s seed] [--room name] [--corpus file]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    config.threads = std::max(1, std::min(config.threads, config.clients));
+    config.mode = std::max(0, std::min(config.mode, 2));
+    config.wpm = std::max(1.0, config.wpm);
+    config.errorRate = std::max(0.0, std::min(config.errorRate, 0.9));
+
+    ParagraphCorpus corpus;
+    if (corpusPath && !corpus.open(corpusPath))
+    {
+        fprintf(stderr, "Cannot open corpus %s, using the built-in paragraphs\n", corpusPath);
+    }
+    config.corpus = &corpus;
+    raiseFileLimit();
+
+    std::vector<std::unique_ptr<LoadThread>> loaders;
+    for (int t = 0; t < config.threads; t++)
+        loaders.emplace_back(new LoadThread(config, t));
+    for (int i = 0; i < config.clients; i++)
+        loaders[i % config.threads]->addClient(i);
+
+    std::vector<LoadResult> results(config.threads);
+    std::vector<std::thread> threads;
+    double start = now();
+    for (int t = 0; t < config.threads; t++)
+        threads.emplace_back(&LoadThread::run, loaders[t].get(), std::ref(results[t]));
+    for (std::thread &thread : threads)
+        thread.join();
+    double seconds = now() - start;
+
+    LoadResult total;
+    for (LoadResult &result : results)
+    {
+        total.connected += result.connected;
+        total.keys += result.keys;
+        total.standings += result.standings;
+        total.racesDone += result.racesDone;
+        total.failures += result.failures;
+        total.latencies.insert(total.latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+
+    printf("clients     %llu connected, %llu failed\n", (unsigned long long)total.connected,
+           (unsigned long long)total.failures);
+    printf("races       %llu finished of %llu\n", (unsigned long long)total.racesDone,
+           (unsigned long long)config.clients * config.races);
+    printf("keys        %llu in %.1f s, %.0f keys/s\n", (unsigned long long)total.keys, seconds, total.keys / seconds);
+    printf("standings   %llu received, %.0f/s\n", (unsigned long long)total.standings, total.standings / seconds);
+    printf("update lag  p50 %.1f ms, p99 %.1f ms, max %.1f ms (%zu batches)\n", percentile(total.latencies, 0.5) * 1000,
+           percentile(total.latencies, 0.99) * 1000, percentile(total.latencies, 1.0) * 1000, total.latencies.size());
+    return total.failures == 0 && total.racesDone == (uint64_t)config.clients * config.races ? 0 : 1;
+}
@@ -0,0 +1,653 @@
+// Race server: hosts many typing races at once over loopback TCP or a Unix
+// socket. Every worker thread runs its own epoll loop and owns its connections
+// and the races formed on them, so workers share nothing while a race runs.
+// Players are scored by the same TextMode classes as the app; key times come
+// from the server clock when a batch arrives, never from the client.
+// Linux only (epoll).
+#include "RaceProtocol.h"
+#include "TypingCore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/epoll.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+const double TICK_SECONDS = 0.05; // standings are sent at most this often
+
+std::atomic<bool> stopping(false);
+std::atomic<uint32_t> nextPlayerId(1);
+
+double serverTime()
+{
+    static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+struct ServerConfig
+{
+    int workers;
+    int roomSize;
+    double waitSeconds;
+    const ParagraphCorpus *corpus;
+};
+
+struct Race;
+
+struct Player
+{
+    RaceConnection connection;
+    uint32_t id;
+    char name[RACE_NAME_LENGTH];
+    Race *race;
+    std::unique_ptr<TextMode> session;
+    bool watchingWrites;
+    bool broken; // output could not be queued; dropped on the next tick
+};
+
+struct Race
+{
+    uint32_t id;
+    int mode;
+    std::string key; // mode and room name, while the race is still open to join
+    int paragraph;
+    double created;
+    bool started;
+    double startTime;
+    bool dirty;
+    std::vector<Player *> players;
+};
+
+// A connection moving onto a worker: fresh from accept(), or handed over by
+// another worker together with the bytes it had not processed or not sent yet
+struct Handoff
+{
+    int fd;
+    uint32_t playerId;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output; // must reach the client before anything the new worker sends
+};
+
+TextMode *makeSession(int mode)
+{
+    switch (mode)
+    {
+    case 1:
+        return new MediumMode();
+    case 2:
+        return new HardMode();
+    default:
+        return new EasyMode();
+    }
+}
+
+// Named rooms live on one worker chosen by hashing the room, so everyone in it
+// races together; public races stay on the worker the player connected to
+uint32_t roomHash(const std::string &key)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : key)
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    return hash;
+}
+
+class Worker
+{
+private:
+    int index;
+    const ServerConfig &config;
+    std::vector<std::unique_ptr<Worker>> &workers;
+    int epollFd;
+    int wakePipe[2];
+    std::mutex handoffLock;
+    std::vector<Handoff> handoffs;
+    ManualClock clock;
+    std::unordered_map<int, std::unique_ptr<Player>> players; // by socket
+    std::vector<std::unique_ptr<Race>> races;
+    std::unordered_map<std::string, Race *> openRaces;
+    uint32_t nextRaceId;
+    std::vector<Player *> ranking;
+    std::vector<RaceStanding> standings;
+    std::vector<uint8_t> payload;
+
+    void watch(Player &player, bool writes)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP | (writes ? (uint32_t)EPOLLOUT : 0u);
+        event.data.fd = player.connection.getFd();
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, event.data.fd, &event);
+        player.watchingWrites = writes;
+    }
+
+    // Returns false if the player has to be dropped
+    bool flush(Player &player)
+    {
+        if (!player.connection.flush())
+            return false;
+        bool pending = player.connection.hasPendingOutput();
+        if (pending != player.watchingWrites)
+            watch(player, pending);
+        return true;
+    }
+
+    void send(Player &player, RaceMessageType type, const void *data, size_t length)
+    {
+        if (!player.connection.send(type, data, length) || !flush(player))
+            player.broken = true;
+    }
+
+    void leaveRace(Player &player)
+    {
+        Race *race = player.race;
+        if (!race)
+            return;
+        race->players.erase(std::find(race->players.begin(), race->players.end(), &player));
+        race->dirty = true;
+        player.race = nullptr;
+    }
+
+    void drop(int fd)
+    {
+        auto it = players.find(fd);
+        if (it == players.end())
+            return;
+        leaveRace(*it->second);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        players.erase(it);
+        playerCount--;
+    }
+
+    void startRace(Race &race)
+    {
+        race.started = true;
+        race.startTime = clock.now();
+        race.dirty = true;
+        auto open = openRaces.find(race.key);
+        if (open != openRaces.end() && open->second == &race)
+            openRaces.erase(open);
+
+        RaceStart start = {};
+        start.raceId = race.id;
+        start.paragraph = (uint32_t)race.paragraph;
+        start.mode = (uint8_t)race.mode;
+        start.players = (uint8_t)race.players.size();
+        for (Player *player : race.players)
+        {
+            player->session->startGame();
+            start.playerId = player->id;
+            start.timeLimit = player->session->getTimeLimit();
+            send(*player, RACE_START, &start, sizeof(start));
+        }
+    }
+
+    void joinRace(Player &player, const RaceJoin &join, const std::string &key)
+    {
+        leaveRace(player);
+        memcpy(player.name, join.name, RACE_NAME_LENGTH);
+        player.name[RACE_NAME_LENGTH - 1] = '\0';
+        player.session.reset(makeSession(join.mode));
+        player.session->setClock(&clock);
+        player.session->setCorpus(config.corpus);
+
+        Race *race = nullptr;
+        auto open = openRaces.find(key);
+        if (open != openRaces.end())
+            race = open->second;
+        if (!race)
+        {
+            std::unique_ptr<Race> created(new Race());
+            created->id = ((uint32_t)index << 24) | (nextRaceId++ & 0xFFFFFF);
+            created->mode = join.mode;
+            created->key = key;
+            player.session->selectRandomParagraph();
+            created->paragraph = player.session->getCurrentParagraph();
+            created->created = clock.now();
+            created->started = false;
+            created->startTime = 0;
+            created->dirty = false;
+            race = created.get();
+            races.push_back(std::move(created));
+            openRaces[key] = race;
+        }
+
+        player.session->selectParagraph(race->paragraph);
+        race->players.push_back(&player);
+        race->dirty = true;
+        player.race = race;
+        if ((int)race->players.size() >= config.roomSize)
+            startRace(*race);
+    }
+
+    // Moves a player, with the JOIN it just sent, to the worker that owns its room
+    void handOver(Player &player, const RaceHeader &header, const uint8_t *data, Worker &owner)
+    {
+        Handoff handoff;
+        handoff.playerId = player.id;
+        const uint8_t *headerBytes = (const uint8_t *)&header;
+        handoff.input.assign(headerBytes, headerBytes + sizeof(header));
+        handoff.input.insert(handoff.input.end(), data, data + header.length);
+        std::vector<uint8_t> rest; // data points into the input, so it is copied first
+        player.connection.takeInput(rest);
+        handoff.input.insert(handoff.input.end(), rest.begin(), rest.end());
+
+        int fd = player.connection.getFd();
+        leaveRace(player);
+        player.connection.takeOutput(handoff.output);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        handoff.fd = player.connection.release();
+        players.erase(fd);
+        playerCount--;
+        owner.adopt(std::move(handoff));
+    }
+
+    // Returns false if the player has to be dropped; true also when it was handed over
+    bool process(Player &player)
+    {
+        RaceHeader header;
+        const uint8_t *data;
+        while (player.connection.next(header, data))
+        {
+            if (header.type == RACE_JOIN)
+            {
+                if (header.length != sizeof(RaceJoin))
+                    return false;
+                RaceJoin join;
+                memcpy(&join, data, sizeof(join));
+                if (join.mode > 2)
+                    return false;
+                join.room[RACE_NAME_LENGTH - 1] = '\0';
+
+                std::string key = std::to_string(join.mode) + "/" + join.room;
+                int owner = join.room[0] ? (int)(roomHash(key) % workers.size()) : index;
+                if (owner != index)
+                {
+                    handOver(player, header, data, *workers[owner]);
+                    return true;
+                }
+                joinRace(player, join, key);
+            }
+            else if (header.type == RACE_KEYS)
+            {
+                if (header.length % 4 != 0 || header.length > RACE_MAX_KEYS * 4)
+                    return false;
+                Race *race = player.race;
+                if (!race || !race->started)
+                    continue; // keys before the start or after leaving do not count
+
+                // The whole batch gets the time it arrived
+                double now = serverTime();
+                clock.set(now);
+                int count = header.length / 4;
+                for (int i = 0; i < count; i++)
+                {
+                    uint32_t codepoint;
+                    memcpy(&codepoint, data + 4 * i, 4);
+                    player.session->checkInput((int)codepoint, now);
+                }
+                race->dirty = true;
+                keyCount += count;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool ranksAhead(Player *a, Player *b)
+    {
+        TextMode &x = *a->session;
+        TextMode &y = *b->session;
+        if (x.getIsCompleted() != y.getIsCompleted())
+            return x.getIsCompleted();
+        if (x.getIsCompleted() && x.getCompletionTime() != y.getCompletionTime())
+            return x.getCompletionTime() < y.getCompletionTime();
+        if (x.getCurrentPosition() != y.getCurrentPosition())
+            return x.getCurrentPosition() > y.getCurrentPosition();
+        if (x.getMistakes() != y.getMistakes())
+            return x.getMistakes() < y.getMistakes();
+        return a->id < b->id;
+    }
+
+    void sendStandings(Race &race, RaceMessageType type)
+    {
+        double now = clock.now();
+        ranking.assign(race.players.begin(), race.players.end());
+        std::sort(ranking.begin(), ranking.end(), ranksAhead);
+
+        standings.resize(ranking.size());
+        for (size_t i = 0; i < ranking.size(); i++)
+        {
+            TextMode &session = *ranking[i]->session;
+            float wpm = session.isComplete() ? session.getWPM()
+                                             : (session.getCurrentPosition() / 5.0f) / (float)(std::max(1.0, now - race.startTime) / 60.0);
+            RaceStanding &row = standings[i];
+            row = RaceStanding();
+            row.playerId = ranking[i]->id;
+            row.position = (uint32_t)session.getCurrentPosition();
+            row.mistakes = (uint16_t)std::min(session.getMistakes(), 0xFFFF);
+            row.wpmTenths = (uint16_t)std::min(std::max(wpm * 10.0f, 0.0f), 65535.0f);
+            row.rank = (uint8_t)std::min(i + 1, (size_t)255);
+            row.finished = session.isComplete() ? 1 : 0;
+            memcpy(row.name, ranking[i]->name, RACE_NAME_LENGTH);
+        }
+
+        RaceStandingsHeader header = {};
+        header.raceId = race.id;
+        header.players = (uint8_t)ranking.size();
+        header.elapsed = (float)(now - race.startTime);
+        int shown = std::min((int)standings.size(), RACE_STANDINGS_SHOWN);
+        for (size_t i = 0; i < ranking.size(); i++)
+        {
+            // The leaders, plus the player's own row when it is further down
+            header.count = (uint8_t)(shown + ((int)i >= shown ? 1 : 0));
+            payload.resize(sizeof(header) + header.count * sizeof(RaceStanding));
+            memcpy(payload.data(), &header, sizeof(header));
+            memcpy(payload.data() + sizeof(header), standings.data(), shown * sizeof(RaceStanding));
+            if ((int)i >= shown)
+                memcpy(payload.data() + sizeof(header) + shown * sizeof(RaceStanding), &standings[i], sizeof(RaceStanding));
+            send(*ranking[i], type, payload.data(), payload.size());
+        }
+    }
+
+    void tick()
+    {
+        double now = clock.now();
+        for (size_t i = 0; i < races.size();)
+        {
+            Race &race = *races[i];
+            if (!race.started && !race.players.empty() && now - race.created >= config.waitSeconds)
+                startRace(race);
+
+            bool over = race.players.empty();
+            if (race.started && !over)
+            {
+                over = true;
+                for (Player *player : race.players)
+                {
+                    player->session->updateTimer();
+                    over = over && player->session->isComplete();
+                }
+                if (over)
+                {
+                    sendStandings(race, RACE_FINISHED);
+                    for (Player *player : race.players)
+                        player->race = nullptr;
+                }
+                else if (race.dirty)
+                {
+                    sendStandings(race, RACE_STANDINGS);
+                    race.dirty = false;
+                }
+            }
+
+            if (over)
+            {
+                auto open = openRaces.find(race.key);
+                if (open != openRaces.end() && open->second == &race)
+                    openRaces.erase(open);
+                races[i] = std::move(races.back());
+                races.pop_back();
+                continue;
+            }
+            i++;
+        }
+        raceCount = races.size();
+
+        // Players that fell too far behind reading their standings are dropped
+        std::vector<int> broken;
+        for (auto &item : players)
+        {
+            if (item.second->broken)
+                broken.push_back(item.first);
+        }
+        for (int fd : broken)
+            drop(fd);
+    }
+
+    void adoptPending()
+    {
+        char drain[64];
+        while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+        {
+        }
+
+        std::vector<Handoff> arrived;
+        {
+            std::lock_guard<std::mutex> lock(handoffLock);
+            arrived.swap(handoffs);
+        }
+        for (Handoff &handoff : arrived)
+        {
+            std::unique_ptr<Player> player(new Player());
+            player->connection.open(handoff.fd);
+            player->connection.putInput(handoff.input);
+            player->connection.putOutput(handoff.output);
+            player->id = handoff.playerId ? handoff.playerId : nextPlayerId++;
+            player->name[0] = '\0';
+            player->race = nullptr;
+            player->watchingWrites = false;
+            player->broken = false;
+
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = handoff.fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, handoff.fd, &event) != 0)
+                continue;
+            Player &added = *player;
+            players[handoff.fd] = std::move(player);
+            playerCount++;
+            if (!flush(added) || !process(added))
+                drop(handoff.fd);
+        }
+    }
+
+public:
+    std::atomic<size_t> playerCount;
+    std::atomic<size_t> raceCount;
+    std::atomic<uint64_t> keyCount;
+
+    Worker(int workerIndex, const ServerConfig &serverConfig, std::vector<std::unique_ptr<Worker>> &all)
+        : index(workerIndex), config(serverConfig), workers(all), nextRaceId(1), playerCount(0), raceCount(0), keyCount(0)
+    {
+        epollFd = epoll_create1(0);
+        if (pipe(wakePipe) != 0)
+            wakePipe[0] = wakePipe[1] = -1;
+        setNonBlocking(wakePipe[0]);
+        setNonBlocking(wakePipe[1]);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wakePipe[0];
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakePipe[0], &event);
+    }
+
+    ~Worker()
+    {
+        players.clear();
+        close(epollFd);
+        close(wakePipe[0]);
+        close(wakePipe[1]);
+    }
+
+    bool isReady() { return epollFd >= 0 && wakePipe[0] >= 0; }
+
+    // Called from any thread
+    void adopt(Handoff handoff)
+    {
+        {
+            std::lock_guard<std::mutex> lock(handoffLock);
+            handoffs.push_back(std::move(handoff));
+        }
+        char wake = 1;
+        if (write(wakePipe[1], &wake, 1) < 0)
+        {
+            // The pipe is full, so a wakeup is already pending
+        }
+    }
+
+    void run()
+    {
+        epoll_event events[256];
+        double nextTick = serverTime() + TICK_SECONDS;
+        while (!stopping)
+        {
+            int timeout = (int)std::max(0.0, (nextTick - serverTime()) * 1000.0);
+            int count = epoll_wait(epollFd, events, 256, timeout);
+            clock.set(serverTime());
+            for (int i = 0; i < count; i++)
+            {
+                int fd = events[i].data.fd;
+                if (fd == wakePipe[0])
+                {
+                    adoptPending();
+                    continue;
+                }
+                auto it = players.find(fd);
+                if (it == players.end())
+                    continue;
+                Player &player = *it->second;
+                bool ok = true;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    ok = player.connection.receive() && process(player);
+                // process() may have handed the player to another worker
+                it = players.find(fd);
+                if (ok && it != players.end() && (events[i].events & EPOLLOUT))
+                    ok = flush(*it->second);
+                if (!ok)
+                    drop(fd);
+            }
+
+            clock.set(serverTime());
+            if (clock.now() >= nextTick)
+            {
+                tick();
+                nextTick = clock.now() + TICK_SECONDS;
+            }
+        }
+    }
+};
+
+void onSignal(int)
+{
+    stopping = true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *address = RACE_DEFAULT_ADDRESS;
+    const char *corpusPath = nullptr;
+    ServerConfig config = {(int)std::thread::hardware_concurrency(), 8, 5.0, nullptr};
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            address = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            config.workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            config.roomSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            config.waitSeconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+            corpusPath = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-l host:port|unix:/path] [-j workers] [-r room_size] [-w wait_seconds] [--corpus file]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    config.workers = std::max(1, config.workers);
+    config.roomSize = std::max(1, std::min(config.roomSize, RACE_MAX_PLAYERS));
+
+    // Clients must use the same corpus, since races only send paragraph numbers
+    ParagraphCorpus corpus;
+    if (corpusPath && !corpus.open(corpusPath))
+    {
+        fprintf(stderr, "Cannot open corpus %s, using the built-in paragraphs\n", corpusPath);
+    }
+    config.corpus = &corpus;
+
+    int listenFd = raceListen(address);
+    if (listenFd < 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", address, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    raiseFileLimit();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < config.workers; i++)
+    {
+        workers.emplace_back(new Worker(i, config, workers));
+        if (!workers.back()->isReady())
+        {
+            fprintf(stderr, "Cannot create worker %d\n", i);
+            return 1;
+        }
+    }
+    std::vector<std::thread> threads;
+    for (auto &worker : workers)
+        threads.emplace_back(&Worker::run, worker.get());
+
+    printf("Racing on %s with %d workers, %d players per race\n", address, config.workers, config.roomSize);
+    fflush(stdout);
+
+    // The main thread accepts and deals new connections out to the workers in turn
+    int nextWorker = 0;
+    uint64_t lastKeys = 0;
+    double lastReport = serverTime();
+    setNonBlocking(listenFd);
+    pollfd listener = {listenFd, POLLIN, 0};
+    while (!stopping)
+    {
+        if (poll(&listener, 1, 1000) > 0)
+        {
+            int fd;
+            while ((fd = accept(listenFd, nullptr, nullptr)) >= 0)
+            {
+                setNonBlocking(fd);
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on Unix sockets
+                workers[nextWorker]->adopt(Handoff{fd, 0, std::vector<uint8_t>(), std::vector<uint8_t>()});
+                nextWorker = (nextWorker + 1) % config.workers;
+            }
+        }
+
+        double now = serverTime();
+        if (now - lastReport >= 5.0)
+        {
+            size_t playerTotal = 0, raceTotal = 0;
+            uint64_t keyTotal = 0;
+            for (auto &worker : workers)
+            {
+                playerTotal += worker->playerCount;
+                raceTotal += worker->raceCount;
+                keyTotal += worker->keyCount;
+            }
+            printf("%zu players, %zu races, %.0f keys/s\n", playerTotal, raceTotal, (keyTotal - lastKeys) / (now - lastReport));
+            fflush(stdout);
+            lastKeys = keyTotal;
+            lastReport = now;
+        }
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+    close(listenFd);
+    if (strncmp(address, "unix:", 5) == 0)
+        unlink(address + 5);
+    return 0;
+}